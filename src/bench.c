@@ -0,0 +1,193 @@
+#include "bench.h"
+
+//throughput benchmark without the synths: the adc is triggered internally
+//(RP_TRIG_SRC_NOW) on a fixed schedule and every ramp goes through the same
+//transfer, writer and missed-ramp accounting as the capture loop in main.c.
+//a trigger slot that passes while the loop is busy counts as missed.
+
+static const rp_acq_decimation_t bench_decimation[] = {RP_DEC_1, RP_DEC_8, RP_DEC_64};
+static const int bench_factor[] = {1, 8, 64};
+static const uint32_t bench_sizes[] = {640, 1280, 2560, 5120, 10240};
+
+
+static Synthesizer* bench_synth[2];
+
+
+static int runRate(Experiment *experiment, double rate, BenchRun *run)
+{
+	double period = 1/rate;
+	double refill = ADC_REFILL_MARGIN*experiment->ns_ext_buffer*(double)experiment->decFactor/ADC_RATE;
+	rp_acq_trig_src_t source;
+	RampMeta* meta;
+	uint32_t ramp = 0;
+	
+	memset(run, 0, sizeof(BenchRun));
+	run->rate = rate;
+	
+	if (!initWriter(experiment, bench_synth[0], bench_synth[1], AUX_CPU))
+		return 0;
+	
+	initGapCounter(period);
+	rp_AcqStart();
+	usleep(ADC_BUFFER_SIZE*(double)experiment->decFactor/ADC_RATE*1e6);
+	
+	double t_start = monotonicTime();
+	long slot = 0;
+	
+	while (run->n_ramps < BENCH_RAMPS)
+	{
+		//wait for the next trigger slot
+		while (monotonicTime() < t_start + slot*period);
+		
+		rp_AcqSetTriggerSrc(RP_TRIG_SRC_NOW);
+		
+		do
+			rp_AcqGetTriggerSrc(&source);
+		while (source != 0);
+		
+		double trigger_time = monotonicTime();
+		uint32_t gap = countGap(t_start + slot*period, &ramp);
+		
+		run->n_missed += gap;
+		run->n_ramps++;
+		
+		int16_t* buffer = getWriterSlot(&meta);
+		rp_AcqGetLatestDataRaw(RP_CH_1, &experiment->ns_ext_buffer, buffer);
+		rp_AcqStart();
+		
+		double transfer = monotonicTime() - trigger_time;
+		
+		meta->ramp = ramp;
+		meta->flags = gap ? RAMP_GAP : RAMP_OK;
+		meta->t = trigger_time;
+		
+		if (CALIBRATION_LOOP*period - transfer < refill)
+		{
+			run->n_corrupt++;
+			meta->flags |= RAMP_CORRUPT;
+		}
+		
+		commitWriterSlot();
+		
+		double t_end = monotonicTime();
+		run->max_loop = fmax(run->max_loop, (t_end - trigger_time)*1e6);
+		
+		//slots that passed during this loop are counted as missed on the next trigger
+		slot = (long)ceil((t_end - t_start)/period);
+	}
+	
+	run->n_dropped = getWriterDropped();
+	dnitWriter();
+	remove(experiment->ch1_filename);
+	
+	return 1;
+}
+
+
+static int isClean(const BenchRun *run)
+{
+	return !run->n_corrupt && !run->n_missed && !run->n_dropped;
+}
+
+
+//highest rate without corrupt, missed or dropped ramps for the current decimation and size
+static double sweepRate(Experiment *experiment, BenchRun *best)
+{
+	BenchRun run;
+	double pass = 0;
+	double fail = 0;
+	
+	memset(best, 0, sizeof(BenchRun));
+	
+	for (double rate = BENCH_START_RATE; rate <= BENCH_MAX_RATE; rate *= 2)
+	{
+		if (!runRate(experiment, rate, &run))
+			return 0;
+		
+		if (!isClean(&run))
+		{
+			fail = rate;
+			break;
+		}
+		
+		pass = rate;
+		*best = run;
+	}
+	
+	if (!fail || !pass)
+		return pass;
+	
+	for (int i = 0; i < BENCH_BISECTIONS; i++)
+	{
+		double rate = 0.5*(pass + fail);
+		
+		if (!runRate(experiment, rate, &run))
+			break;
+		
+		if (isClean(&run))
+		{
+			pass = rate;
+			*best = run;
+		}
+		else
+		{
+			fail = rate;
+		}
+	}
+	
+	return pass;
+}
+
+
+//the synths are not used, they only fill the ramp table of the container header
+int runBenchmark(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo)
+{
+	int n_decimations = sizeof(bench_factor)/sizeof(bench_factor[0]);
+	int n_sizes = sizeof(bench_sizes)/sizeof(bench_sizes[0]);
+	BenchRun best;
+	
+	bench_synth[0] = synthOne;
+	bench_synth[1] = synthTwo;
+	snprintf(experiment->ch1_filename, PATH_SIZE, "%s/bench.cap", experiment->storageDir);
+	snprintf(experiment->timeStamp, STAMP_SIZE, "benchmark");
+	experiment->n_ramps = BENCH_RAMPS;
+	experiment->is_placeholder = 0;
+	experiment->segment_size = 0;
+	experiment->segment_ramps = 0;
+	
+	pinThread(pthread_self(), ACQ_CPU);
+	rp_AcqSetAveraging(false);
+	rp_AcqSetTriggerDelay(-ADC_BUFFER_SIZE/2);
+	
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("Internal trigger benchmark, %i ramps per rate, %s samples on %s\n", BENCH_RAMPS, 
+		sampleFormatName(experiment->sample_format), experiment->storageDir);
+	printf("%10s %8s %10s %10s %10s\n", "decimation", "samples", "max prf", "loop", "period");
+	printf("%10s %8s %10s %10s %10s\n", "", "", "[Hz]", "[us]", "[us]");
+	
+	for (int i = 0; i < n_decimations; i++)
+	{
+		experiment->decFactor = bench_factor[i];
+		rp_AcqSetDecimation(bench_decimation[i]);
+		
+		for (int j = 0; j < n_sizes; j++)
+		{
+			experiment->ns_ext_buffer = bench_sizes[j];
+			
+			//a capture longer than the adc buffer cannot be transferred
+			if (bench_sizes[j] > ADC_BUFFER_SIZE)
+				continue;
+			
+			double rate = sweepRate(experiment, &best);
+			
+			if (rate > 0)
+				printf("%10i %8u %10.0f %10.1f %10.1f\n", bench_factor[i], bench_sizes[j], rate, best.max_loop, 1e6/rate);
+			else
+				printf("%10i %8u %10s\n", bench_factor[i], bench_sizes[j], "-");
+		}
+	}
+	
+	rp_AcqSetTriggerSrc(RP_TRIG_SRC_DISABLED);
+	
+	return 1;
+}
@@ -0,0 +1,32 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "controller.h"
+#include "calibrate.h"
+#include "writer.h"
+#include "gaps.h"
+#include "colour.h"
+
+#define BENCH_RAMPS				2000		//ramps captured per rate
+#define BENCH_START_RATE		250.0		//first rate tried [Hz]
+#define BENCH_MAX_RATE			32000.0		//rates above this are not tried [Hz]
+#define BENCH_BISECTIONS		5			//refinement steps between the last pass and first fail
+
+typedef struct
+{
+	double rate;							//trigger rate [Hz]
+	int n_ramps;							//ramps captured
+	int n_corrupt;							//transfer overran the adc refill time
+	int n_missed;							//trigger slots that went by while the loop was busy
+	int n_dropped;							//ramps dropped because the writer fell behind
+	double max_loop;						//longest capture loop [us]
+} BenchRun;
+
+int  runBenchmark(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo);
+
+#endif
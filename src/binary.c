@@ -65,4 +65,34 @@ uint8_t checkBit(uint32_t reg, uint8_t bit)
 }
 
 
+//reinterpret a big-endian ieee-754 register directly instead of rebuilding it bit by bit
+float bit8ArrayToFloatFast(const uint8_t *data)
+{
+	uint32_t bit32 = bit8ArrayToBit32((uint8_t*)data);
+	float singleFloat;
+	
+	memcpy(&singleFloat, &bit32, sizeof(float));
+	
+	return singleFloat;
+}
+
 
+//decode n_values consecutive big-endian floats, e.g. the 12 registers of a DREG_ALL_PROC batch
+void bit8ArrayToFloatBatch(const uint8_t *data, float *values, int n_values)
+{
+	int i = 0;
+	
+#ifdef __ARM_NEON
+	//byte swap four registers per iteration
+	for (; i + 4 <= n_values; i += 4)
+	{
+		uint8x16_t bytes = vld1q_u8(&data[4*i]);
+		vst1q_u8((uint8_t*)&values[i], vrev32q_u8(bytes));
+	}
+#endif
+	
+	for (; i < n_values; i++)
+	{
+		values[i] = bit8ArrayToFloatFast(&data[4*i]);
+	}
+}
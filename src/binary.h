@@ -9,6 +9,11 @@
 #include <errno.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
 
 #include "colour.h"
 
@@ -17,4 +22,7 @@ float bit32ToFloat(uint32_t bit32);
 float bit8ArrayToFloat(uint8_t *data);
 uint8_t checkBit(uint32_t reg, uint8_t bit);
 
+float bit8ArrayToFloatFast(const uint8_t *data);
+void bit8ArrayToFloatBatch(const uint8_t *data, float *values, int n_values);
+
 #endif
@@ -0,0 +1,224 @@
+#include "calibrate.h"
+
+//transfer cost is assumed linear in the number of samples. the capture loop
+//keeps up if transfer and adc refill both fit within the trigger period:
+//  fixed + n*(per_sample + ADC_REFILL_MARGIN*refill_per_sample) <= CALIBRATION_LOOP*period
+
+static const uint32_t calibration_sizes[] = {256, 512, 1024, 2048, 4096, 8192};
+
+static Calibration calibration;
+
+
+static int compareDouble(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	
+	return (x > y) - (x < y);
+}
+
+
+//time adc transfers of increasing size and fit fixed and per-sample cost
+int calibrateTransfer(Experiment *experiment)
+{
+	int n_sizes = sizeof(calibration_sizes)/sizeof(calibration_sizes[0]);
+	int16_t* buffer = (int16_t*)malloc(ADC_BUFFER_SIZE*sizeof(int16_t));
+	double duration[CALIBRATION_REPEATS];
+	double sum_n = 0, sum_t = 0, sum_nn = 0, sum_nt = 0;
+	double t_size[n_sizes];
+	
+	memset(&calibration, 0, sizeof(Calibration));
+	calibration.refill_per_sample = (double)experiment->decFactor/ADC_RATE*1e6;
+	
+	if (!buffer)
+		return 0;
+	
+	rp_AcqStart();
+	usleep(ADC_BUFFER_SIZE*calibration.refill_per_sample);
+	
+	for (int i = 0; i < n_sizes; i++)
+	{
+		for (int j = 0; j < CALIBRATION_REPEATS; j++)
+		{
+			uint32_t ns = calibration_sizes[i];
+			double start = monotonicTime();
+			
+			//same calls as the capture loop between trigger and restart
+			rp_AcqGetLatestDataRaw(RP_CH_1, &ns, buffer);
+			rp_AcqStart();
+			
+			duration[j] = (monotonicTime() - start)*1e6;
+		}
+		
+		//a high percentile so that occasional preemption is covered but not dominant
+		qsort(duration, CALIBRATION_REPEATS, sizeof(double), compareDouble);
+		t_size[i] = duration[(int)(CALIBRATION_PERCENTILE*(CALIBRATION_REPEATS - 1))];
+		
+		sum_n += calibration_sizes[i];
+		sum_t += t_size[i];
+		sum_nn += (double)calibration_sizes[i]*calibration_sizes[i];
+		sum_nt += calibration_sizes[i]*t_size[i];
+	}
+	
+	free(buffer);
+	
+	double det = n_sizes*sum_nn - sum_n*sum_n;
+	
+	calibration.n_sizes = n_sizes;
+	calibration.transfer_per_sample = (n_sizes*sum_nt - sum_n*sum_t)/det;
+	calibration.transfer_fixed = (sum_t - calibration.transfer_per_sample*sum_n)/n_sizes;
+	
+	double sum_rr = 0;
+	
+	for (int i = 0; i < n_sizes; i++)
+	{
+		double r = t_size[i] - (calibration.transfer_fixed + calibration.transfer_per_sample*calibration_sizes[i]);
+		sum_rr += r*r;
+	}
+	
+	calibration.transfer_residual = sqrt(sum_rr/n_sizes);
+	
+	if (experiment->is_debug_mode)
+	{
+		cprint("[**] ", BRIGHT, CYAN);
+		printf("Transfer: %.2f us + %.4f us/sample (rms %.2f us)\n", calibration.transfer_fixed, 
+			calibration.transfer_per_sample, calibration.transfer_residual);
+	}
+	
+	return (calibration.transfer_per_sample > 0);
+}
+
+
+//start the synths, time the adc trigger and stop them again so that they wait on ramp0
+int calibrateTrigger(Synthesizer *synthOne, Synthesizer *synthTwo)
+{
+	double t[CALIBRATION_TRIGGERS + 1];
+	double interval[CALIBRATION_TRIGGERS];
+	rp_acq_trig_src_t source;
+	int n = 0;
+	
+	setRegister(synthOne, 58, 0b00100001);
+	setRegister(synthTwo, 58, 0b00100001);
+	
+	rp_AcqStart();
+	rp_AcqSetTriggerSrc(RP_TRIG_SRC_EXT_PE);
+	pulseTrigger(synthOne, synthTwo);
+	
+	double t_end = monotonicTime() + CALIBRATION_TIMEOUT;
+	
+	while ((n <= CALIBRATION_TRIGGERS) && (monotonicTime() < t_end))
+	{
+		rp_AcqGetTriggerSrc(&source);
+		
+		if (source == 0)
+		{
+			t[n++] = monotonicTime();
+			rp_AcqStart();
+			rp_AcqSetTriggerSrc(RP_TRIG_SRC_EXT_PE);
+		}
+	}
+	
+	setRegister(synthOne, 58, 0b00100000);
+	setRegister(synthTwo, 58, 0b00100000);
+	rp_AcqSetTriggerSrc(RP_TRIG_SRC_DISABLED);
+	
+	calibration.n_triggers = n - 1;
+	
+	if (calibration.n_triggers < 2)
+	{
+		calibration.n_triggers = 0;
+		return 0;
+	}
+	
+	for (int i = 0; i < calibration.n_triggers; i++)
+		interval[i] = (t[i + 1] - t[i])*1e6;
+	
+	qsort(interval, calibration.n_triggers, sizeof(double), compareDouble);
+	calibration.trigger_period = interval[calibration.n_triggers/2];
+	
+	//intervals that span a missed trigger are left out of the jitter
+	double sum_dd = 0;
+	int n_used = 0;
+	
+	for (int i = 0; i < calibration.n_triggers; i++)
+	{
+		double d = interval[i] - calibration.trigger_period;
+		
+		if (fabs(d) < 0.25*calibration.trigger_period)
+		{
+			sum_dd += d*d;
+			n_used++;
+		}
+	}
+	
+	calibration.trigger_jitter = n_used ? sqrt(sum_dd/n_used) : 0;
+	
+	return 1;
+}
+
+
+//choose the capture size and loop budget, ns_requested = 0 selects the largest safe size.
+//returns 0 if the chosen configuration cannot keep up with the triggers.
+int applyCalibration(Experiment *experiment, uint32_t ns_requested)
+{
+	if (calibration.trigger_period <= 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("No triggers seen during calibration, using %i us loop.\n", experiment->u_max_loop);
+	}
+	else
+	{
+		experiment->u_max_loop = CALIBRATION_LOOP*calibration.trigger_period;
+	}
+	
+	double per_sample = calibration.transfer_per_sample + ADC_REFILL_MARGIN*calibration.refill_per_sample;
+	double ns_max = (experiment->u_max_loop - calibration.transfer_fixed)/per_sample;
+	
+	if (ns_max > ADC_BUFFER_SIZE)
+		ns_max = ADC_BUFFER_SIZE;
+	
+	calibration.ns_max = (ns_max > 0) ? ((uint32_t)ns_max & ~7u) : 0;
+	
+	if (ns_requested)
+		experiment->ns_ext_buffer = ns_requested;
+	else if (calibration.ns_max)
+		experiment->ns_ext_buffer = calibration.ns_max;
+	
+	calibration.is_feasible = (experiment->ns_ext_buffer <= calibration.ns_max);
+	
+	if (!calibration.is_feasible)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("%i samples cannot keep up with %.1f us triggers, at most %i.\n", experiment->ns_ext_buffer, 
+			calibration.trigger_period, calibration.ns_max);
+	}
+	else
+	{
+		cprint("[OK] ", BRIGHT, GREEN);
+		printf("Calibrated: %i samples per ramp (max %i), %i us loop.\n", experiment->ns_ext_buffer, 
+			calibration.ns_max, experiment->u_max_loop);
+	}
+	
+	return calibration.is_feasible;
+}
+
+
+const Calibration* getCalibration(void)
+{
+	return &calibration;
+}
+
+
+void writeCalibrationSummary(FILE* summaryFile)
+{
+	fprintf(summaryFile, "\n[calibration]\r\n");
+	fprintf(summaryFile, "transfer_fixed = %.3f\r\n", calibration.transfer_fixed);
+	fprintf(summaryFile, "transfer_per_sample = %.5f\r\n", calibration.transfer_per_sample);
+	fprintf(summaryFile, "transfer_residual = %.3f\r\n", calibration.transfer_residual);
+	fprintf(summaryFile, "refill_per_sample = %.5f\r\n", calibration.refill_per_sample);
+	fprintf(summaryFile, "trigger_period = %.3f\r\n", calibration.trigger_period);
+	fprintf(summaryFile, "trigger_jitter = %.3f\r\n", calibration.trigger_jitter);
+	fprintf(summaryFile, "trigger_intervals = %i\r\n", calibration.n_triggers);
+	fprintf(summaryFile, "max_samples = %u\r\n", calibration.ns_max);
+	fprintf(summaryFile, "is_feasible = %i\r\n", calibration.is_feasible);
+}
@@ -0,0 +1,41 @@
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "controller.h"
+#include "colour.h"
+
+#define CALIBRATION_REPEATS		32			//transfers timed per sample count
+#define CALIBRATION_PERCENTILE	0.9			//transfer time taken at this percentile of the repeats
+#define CALIBRATION_TRIGGERS	64			//trigger intervals timed
+#define CALIBRATION_TIMEOUT		1.0			//give up waiting for triggers after [s]
+#define CALIBRATION_LOOP		0.95		//fraction of the trigger period available to the capture loop
+#define ADC_REFILL_MARGIN		1.1			//safety factor on the time the adc needs to refill the buffer
+#define CALIBRATION_MIN_SAMPLES	8			//smallest capture size, -n takes CALIBRATION_MIN_SAMPLES to ADC_BUFFER_SIZE
+
+typedef struct
+{
+	int n_sizes;							//sample counts in the transfer fit
+	double transfer_fixed;					//fixed cost of a transfer and restart [us]
+	double transfer_per_sample;				//cost per transferred sample [us]
+	double transfer_residual;				//rms residual of the fit [us]
+	double refill_per_sample;				//adc time per decimated sample [us]
+	int n_triggers;							//trigger intervals timed
+	double trigger_period;					//median trigger interval [us], 0 if no triggers were seen
+	double trigger_jitter;					//rms deviation from the median [us]
+	uint32_t ns_max;						//largest capture size that keeps up with the triggers
+	int is_feasible;						//requested capture size keeps up
+} Calibration;
+
+int  calibrateTransfer(Experiment *experiment);
+int  calibrateTrigger(Synthesizer *synthOne, Synthesizer *synthTwo);
+int  applyCalibration(Experiment *experiment, uint32_t ns_requested);
+const Calibration* getCalibration(void);
+void writeCalibrationSummary(FILE* summaryFile);
+
+#endif
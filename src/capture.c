@@ -0,0 +1,423 @@
+#include "capture.h"
+
+static uint32_t crc_table[256];
+static int is_crc_table = 0;
+
+static int flushCaptureChunk(CaptureFile* capture);
+static uint64_t chunkSize(const CaptureHeader* header, const CaptureChunkHeader* chunk);
+static int isChunkMapped(const CaptureMap* map, uint64_t offset);
+
+
+//standard crc-32 (ieee 802.3), table driven
+uint32_t captureCrc(uint32_t crc, const void* data, size_t length)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	
+	if (!is_crc_table)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			
+			crc_table[i] = c;
+		}
+		
+		is_crc_table = 1;
+	}
+	
+	crc = ~crc;
+	
+	for (size_t i = 0; i < length; i++)
+		crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	
+	return ~crc;
+}
+
+
+//bytes reserved for one ramp in the chunk payload, an upper bound for compressed frames
+uint32_t captureRampBytes(const CaptureHeader* header)
+{
+	if (header->sample_format == SAMPLE_FORMAT_PACK14)
+		return packedSize(header->ns_ramp);
+	
+	if (header->sample_format == SAMPLE_FORMAT_RICE)
+		return encodedBound(header->ns_ramp);
+	
+	return header->ns_ramp*sizeof(int16_t);
+}
+
+
+const char* sampleFormatName(uint32_t sample_format)
+{
+	switch (sample_format)
+	{
+		case SAMPLE_FORMAT_INT16:
+			return "int16";
+		case SAMPLE_FORMAT_PACK14:
+			return "pack14";
+		case SAMPLE_FORMAT_RICE:
+			return "rice";
+		default:
+			return "unknown";
+	}
+}
+
+
+static uint64_t chunkSize(const CaptureHeader* header, const CaptureChunkHeader* chunk)
+{
+	return sizeof(CaptureChunkHeader) + header->chunk_ramps*sizeof(RampMeta) + chunk->payload_bytes;
+}
+
+
+//a chunk header with its magic at offset, and the whole chunk inside the mapping
+static int isChunkMapped(const CaptureMap* map, uint64_t offset)
+{
+	if ((offset < sizeof(CaptureHeader)) || (offset + sizeof(CaptureChunkHeader) > map->size))
+		return 0;
+	
+	const CaptureChunkHeader* chunk = (const CaptureChunkHeader*)(map->base + offset);
+	
+	return (chunk->magic == CHUNK_MAGIC) && (offset + chunkSize(map->header, chunk) <= map->size);
+}
+
+
+int openCaptureFile(CaptureFile* capture, const char* filename, CaptureHeader* header)
+{
+	FILE* file = fopen(filename, "wb");
+	
+	if (!file)
+		return 0;
+	
+	return attachCaptureFile(capture, file, header);
+}
+
+
+//start a container in a file that has already been opened for writing
+int attachCaptureFile(CaptureFile* capture, FILE* file, CaptureHeader* header)
+{
+	memset(capture, 0, sizeof(CaptureFile));
+	
+	capture->file = file;
+	capture->header = *header;
+	memcpy(capture->header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+	capture->header.version = CAPTURE_VERSION;
+	capture->header.header_size = sizeof(CaptureHeader);
+	capture->header.header_crc = captureCrc(0, &capture->header, offsetof(CaptureHeader, header_crc));
+	
+	capture->ramp_bytes = captureRampBytes(&capture->header);
+	capture->chunk_bytes = sizeof(CaptureChunkHeader) + capture->header.chunk_ramps*(sizeof(RampMeta) + capture->ramp_bytes);
+	capture->chunk = (uint8_t*)calloc(1, capture->chunk_bytes);
+	
+	capture->index_size = 1024;
+	capture->index = (uint64_t*)malloc(capture->index_size*sizeof(uint64_t));
+	
+	//on failure the file is closed here and the container left closed
+	if (!capture->chunk || !capture->index || (fwrite(&capture->header, sizeof(CaptureHeader), 1, capture->file) != 1))
+	{
+		fclose(capture->file);
+		free(capture->chunk);
+		free(capture->index);
+		memset(capture, 0, sizeof(CaptureFile));
+		return 0;
+	}
+	
+	capture->offset = sizeof(CaptureHeader);
+	
+	return 1;
+}
+
+
+//stage a ramp in the current chunk, the chunk is written once it is full
+int appendCaptureRamp(CaptureFile* capture, const int16_t* samples, const RampMeta* meta)
+{
+	RampMeta* metaBlock = (RampMeta*)(capture->chunk + sizeof(CaptureChunkHeader));
+	uint8_t* payload = (uint8_t*)&metaBlock[capture->header.chunk_ramps];
+	RampMeta* slot = &metaBlock[capture->chunk_fill];
+	struct timespec start, end;
+	
+	*slot = *meta;
+	slot->offset = capture->payload_fill;
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	switch (capture->header.sample_format)
+	{
+		case SAMPLE_FORMAT_PACK14:
+			packSamples(samples, payload + slot->offset, capture->header.ns_ramp);
+			slot->bytes = capture->ramp_bytes;
+			break;
+		case SAMPLE_FORMAT_RICE:
+			slot->bytes = encodeRamp(samples, capture->header.ns_ramp, payload + slot->offset);
+			break;
+		default:
+			memcpy(payload + slot->offset, samples, capture->ramp_bytes);
+			slot->bytes = capture->ramp_bytes;
+			break;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	capture->codec_time += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+	
+	capture->raw_bytes += capture->header.ns_ramp*sizeof(int16_t);
+	capture->stored_bytes += slot->bytes;
+	capture->payload_fill += slot->bytes;
+	capture->chunk_fill++;
+	capture->n_ramps++;
+	
+	if (capture->chunk_fill == capture->header.chunk_ramps)
+		return flushCaptureChunk(capture);
+	
+	return 1;
+}
+
+
+static int flushCaptureChunk(CaptureFile* capture)
+{
+	if (capture->chunk_fill == 0)
+		return 1;
+	
+	CaptureChunkHeader* chunk = (CaptureChunkHeader*)capture->chunk;
+	RampMeta* metaBlock = (RampMeta*)(capture->chunk + sizeof(CaptureChunkHeader));
+	uint8_t* payload = (uint8_t*)&metaBlock[capture->header.chunk_ramps];
+	uint32_t n_empty = capture->header.chunk_ramps - capture->chunk_fill;
+	
+	memset(&metaBlock[capture->chunk_fill], 0, n_empty*sizeof(RampMeta));
+	
+	//pad a short final chunk of a fixed size format so that every chunk has the same size
+	if (capture->header.sample_format != SAMPLE_FORMAT_RICE)
+	{
+		memset(payload + capture->payload_fill, 0, n_empty*capture->ramp_bytes);
+		capture->payload_fill += n_empty*capture->ramp_bytes;
+	}
+	
+	chunk->magic = CHUNK_MAGIC;
+	chunk->index = capture->n_chunks;
+	chunk->first_ramp = capture->n_ramps - capture->chunk_fill;
+	chunk->n_ramps = capture->chunk_fill;
+	chunk->payload_bytes = capture->payload_fill;
+	
+	uint64_t chunk_size = chunkSize(&capture->header, chunk);
+	chunk->crc = captureCrc(0, metaBlock, chunk_size - sizeof(CaptureChunkHeader));
+	
+	if (capture->n_chunks == capture->index_size)
+	{
+		capture->index_size *= 2;
+		capture->index = (uint64_t*)realloc(capture->index, capture->index_size*sizeof(uint64_t));
+	}
+	
+	capture->index[capture->n_chunks++] = capture->offset;
+	capture->chunk_fill = 0;
+	capture->payload_fill = 0;
+	
+	if (fwrite(capture->chunk, chunk_size, 1, capture->file) != 1)
+		return 0;
+	
+	capture->offset += chunk_size;
+	
+	return 1;
+}
+
+
+//write the partial chunk, the chunk index and the trailer
+int closeCaptureFile(CaptureFile* capture)
+{
+	if (!capture->file)
+		return 0;
+	
+	int is_ok = flushCaptureChunk(capture);
+	
+	CaptureTrailer trailer;
+	memset(&trailer, 0, sizeof(CaptureTrailer));
+	trailer.magic = INDEX_MAGIC;
+	trailer.n_chunks = capture->n_chunks;
+	trailer.n_ramps = capture->n_ramps;
+	trailer.index_offset = capture->offset;
+	
+	if (fwrite(capture->index, sizeof(uint64_t), capture->n_chunks, capture->file) != capture->n_chunks)
+		is_ok = 0;
+	
+	if (fwrite(&trailer, sizeof(CaptureTrailer), 1, capture->file) != 1)
+		is_ok = 0;
+	
+	if (fclose(capture->file))
+		is_ok = 0;
+	
+	free(capture->chunk);
+	free(capture->index);
+	capture->file = NULL;
+	capture->chunk = NULL;
+	capture->index = NULL;
+	
+	return is_ok;
+}
+
+
+//map a capture file for random access, returns 0 if the file is not a valid container
+int mapCapture(CaptureMap* map, const char* filename)
+{
+	struct stat info;
+	
+	memset(map, 0, sizeof(CaptureMap));
+	
+	if ((map->fd = open(filename, O_RDONLY)) < 0)
+		return 0;
+	
+	if (fstat(map->fd, &info) || info.st_size < (off_t)sizeof(CaptureHeader))
+	{
+		close(map->fd);
+		return 0;
+	}
+	
+	map->size = info.st_size;
+	map->base = (uint8_t*)mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+	
+	if (map->base == MAP_FAILED)
+	{
+		close(map->fd);
+		return 0;
+	}
+	
+	map->header = (CaptureHeader*)map->base;
+	
+	if (memcmp(map->header->magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) || (map->header->version != CAPTURE_VERSION) ||
+		map->header->header_crc != captureCrc(0, map->header, offsetof(CaptureHeader, header_crc)) || (map->header->chunk_ramps == 0))
+	{
+		unmapCapture(map);
+		return 0;
+	}
+	
+	map->ramp_bytes = captureRampBytes(map->header);
+	
+	CaptureTrailer* trailer = (CaptureTrailer*)(map->base + map->size - sizeof(CaptureTrailer));
+	
+	if ((map->size >= sizeof(CaptureHeader) + sizeof(CaptureTrailer)) && (trailer->magic == INDEX_MAGIC) &&
+		(trailer->index_offset >= sizeof(CaptureHeader)) &&
+		(trailer->index_offset + (uint64_t)trailer->n_chunks*sizeof(uint64_t) + sizeof(CaptureTrailer) == map->size))
+	{
+		uint64_t* index = (uint64_t*)(map->base + trailer->index_offset);
+		uint32_t c = 0;
+		
+		//a torn or corrupt index is not trusted, every entry has to point at a whole chunk
+		while ((c < trailer->n_chunks) && isChunkMapped(map, index[c]))
+			c++;
+		
+		if (c == trailer->n_chunks)
+		{
+			map->index = index;
+			map->n_chunks = trailer->n_chunks;
+			map->n_ramps = trailer->n_ramps;
+			return 1;
+		}
+	}
+	
+	//no trailer or a bad index, rebuild the index from the complete chunks
+	uint32_t index_size = 1024;
+	uint64_t offset = sizeof(CaptureHeader);
+	
+	map->is_recovered = 1;
+	map->index = (uint64_t*)malloc(index_size*sizeof(uint64_t));
+	
+	while (isChunkMapped(map, offset))
+	{
+		CaptureChunkHeader* chunk = (CaptureChunkHeader*)(map->base + offset);
+		
+		if (map->n_chunks == index_size)
+		{
+			index_size *= 2;
+			map->index = (uint64_t*)realloc(map->index, index_size*sizeof(uint64_t));
+		}
+		
+		map->index[map->n_chunks++] = offset;
+		map->n_ramps += chunk->n_ramps;
+		offset += chunkSize(map->header, chunk);
+	}
+	
+	return 1;
+}
+
+
+void unmapCapture(CaptureMap* map)
+{
+	if (map->is_recovered)
+		free(map->index);
+	
+	if (map->base && map->base != MAP_FAILED)
+		munmap(map->base, map->size);
+	
+	close(map->fd);
+	memset(map, 0, sizeof(CaptureMap));
+}
+
+
+CaptureChunkHeader* getCaptureChunk(CaptureMap* map, uint32_t chunk)
+{
+	if (chunk >= map->n_chunks)
+		return NULL;
+	
+	return (CaptureChunkHeader*)(map->base + map->index[chunk]);
+}
+
+
+//constant time lookup of a ramp and its metadata, returns the ramp as stored
+void* getCaptureRamp(CaptureMap* map, uint32_t ramp, RampMeta** meta)
+{
+	CaptureChunkHeader* chunk = getCaptureChunk(map, ramp/map->header->chunk_ramps);
+	uint32_t slot = ramp % map->header->chunk_ramps;
+	
+	if (!chunk || slot >= chunk->n_ramps)
+		return NULL;
+	
+	RampMeta* metaBlock = (RampMeta*)((uint8_t*)chunk + sizeof(CaptureChunkHeader));
+	uint8_t* payload = (uint8_t*)&metaBlock[map->header->chunk_ramps];
+	uint64_t length = (map->header->sample_format == SAMPLE_FORMAT_RICE) ? metaBlock[slot].bytes : map->ramp_bytes;
+	
+	//the ramp has to lie inside the chunk payload, the reader copies ramp_bytes of uncompressed formats
+	if ((uint64_t)metaBlock[slot].offset + length > chunk->payload_bytes)
+		return NULL;
+	
+	if (meta)
+		*meta = &metaBlock[slot];
+	
+	return payload + metaBlock[slot].offset;
+}
+
+
+//copy a ramp into ns_ramp samples, unpacking or decompressing if required
+int readCaptureRamp(CaptureMap* map, uint32_t ramp, int16_t* samples, RampMeta** meta)
+{
+	RampMeta* rampMeta;
+	void* data = getCaptureRamp(map, ramp, &rampMeta);
+	
+	if (!data)
+		return 0;
+	
+	if (meta)
+		*meta = rampMeta;
+	
+	switch (map->header->sample_format)
+	{
+		case SAMPLE_FORMAT_PACK14:
+			unpackSamples((const uint8_t*)data, samples, map->header->ns_ramp);
+			return 1;
+		case SAMPLE_FORMAT_RICE:
+			return decodeRamp((const uint8_t*)data, rampMeta->bytes, samples, map->header->ns_ramp);
+		default:
+			memcpy(samples, data, map->header->ns_ramp*sizeof(int16_t));
+			return 1;
+	}
+}
+
+
+//returns 1 if the chunk crc matches its contents
+int checkCaptureChunk(CaptureMap* map, uint32_t chunk)
+{
+	CaptureChunkHeader* header = getCaptureChunk(map, chunk);
+	
+	if (!header || header->magic != CHUNK_MAGIC)
+		return 0;
+	
+	return header->crc == captureCrc(0, (uint8_t*)header + sizeof(CaptureChunkHeader), chunkSize(map->header, header) - sizeof(CaptureChunkHeader));
+}
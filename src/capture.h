@@ -0,0 +1,182 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "pack.h"
+#include "codec.h"
+
+//chunked capture container
+//
+//  CaptureHeader                        fixed, 512 bytes
+//  chunk 0 .. n-1                       CAPTURE_CHUNK_RAMPS ramps each
+//      CaptureChunkHeader
+//      RampMeta[chunk_ramps]
+//      payload_bytes of ramp data       int16_t, 14-bit packed or compressed frames, see sample_format
+//  uint64_t index[n_chunks]             file offset of every chunk
+//  CaptureTrailer                       last 24 bytes of the file
+//
+//a recording may be split into several segment files, each a complete container.
+//ramp numbers passed to the reader are local to the file, RampMeta holds the
+//along-track ramp index, which skips missed triggers unless placeholder ramps
+//are written. the index and trailer are written on close. every chunk records the size of
+//its payload, so a file without a trailer (e.g. after a power failure) can still
+//be read chunk by chunk. chunks of uncompressed formats all have the same size.
+
+#define CAPTURE_MAGIC			"MRPCCAP"
+#define CAPTURE_VERSION			4
+#define CAPTURE_CHUNK_RAMPS		64
+#define CHUNK_MAGIC				0x4B4E4843	//"CHNK"
+#define INDEX_MAGIC				0x58444E49	//"INDX"
+
+#define SAMPLE_FORMAT_INT16		0
+#define SAMPLE_FORMAT_PACK14	1			//14-bit samples packed by packSamples
+#define SAMPLE_FORMAT_RICE		2			//frames compressed by encodeRamp
+
+#define RAMP_OK					0x00
+#define RAMP_CORRUPT			0x01		//transfer overran the adc refill time
+#define RAMP_GAP				0x02		//triggers were missed before this ramp
+#define RAMP_PLACEHOLDER		0x04		//zero ramp standing in for a missed trigger
+#define RAMP_CLIPPED			0x08		//samples reached the 14-bit rails
+#define RAMP_DEAD				0x10		//no signal above the adc noise floor
+
+typedef struct
+{
+	double increment;
+	double bandwidth;						//[MHz]
+	uint16_t length;
+	uint8_t next;
+	uint8_t trigger;
+	uint8_t reset;
+	uint8_t flag;
+	uint8_t doubler;
+	uint8_t reserved;
+} CaptureRamp;
+
+typedef struct
+{
+	uint32_t fractional_numerator;
+	uint32_t reserved;
+	double frequency_offset;				//[MHz]
+	CaptureRamp ramps[8];
+} CaptureSynth;
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t chunk_ramps;					//ramps per chunk
+	uint32_t ns_ramp;						//samples per ramp
+	uint32_t sample_format;					//SAMPLE_FORMAT_*
+	uint32_t decimation;
+	uint32_t adc_channel;
+	uint32_t n_ramps;						//ramps requested
+	double sample_rate;						//[Hz]
+	char timestamp[24];						//experiment folder time stamp
+	char rpc_version[12];
+	uint32_t segment;						//segment number of this file
+	CaptureSynth synth[2];
+	uint32_t first_ramp;					//ramps stored in the preceding segments
+	uint32_t header_crc;					//crc of all preceding header bytes
+} CaptureHeader;
+
+typedef struct
+{
+	int16_t min;
+	int16_t max;
+	uint16_t n_clipped;						//samples on the 14-bit rails
+	uint16_t reserved;
+	float dc;								//mean [adc counts]
+	float rms;								//rms about the mean [adc counts]
+	float hf_ratio;							//first difference energy over twice the variance, 1 for white noise
+} RampStats;
+
+typedef struct
+{
+	uint32_t ramp;							//along-track ramp index, counts missed triggers
+	uint32_t flags;							//RAMP_* flags
+	double t;								//trigger time [s, CLOCK_MONOTONIC_RAW]
+	double t_gps;							//trigger time [s since utc midnight], -1 before gps lock
+	uint32_t offset;						//start of the ramp within the chunk payload
+	uint32_t bytes;							//bytes used by the ramp within the chunk payload
+	RampStats stats;						//signal quality, zero for placeholder ramps
+} RampMeta;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t index;							//chunk number
+	uint32_t first_ramp;
+	uint32_t n_ramps;						//valid ramps in this chunk
+	uint32_t payload_bytes;					//bytes of samples following the metadata block
+	uint32_t crc;							//crc of the metadata block and payload
+} CaptureChunkHeader;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t n_chunks;
+	uint32_t n_ramps;
+	uint32_t reserved;
+	uint64_t index_offset;
+} CaptureTrailer;
+
+typedef struct
+{
+	FILE* file;
+	CaptureHeader header;
+	uint8_t* chunk;							//chunk being assembled
+	uint32_t chunk_bytes;
+	uint32_t ramp_bytes;
+	uint32_t chunk_fill;					//ramps in the chunk being assembled
+	uint32_t payload_fill;					//payload bytes in the chunk being assembled
+	uint32_t n_chunks;
+	uint32_t n_ramps;
+	uint64_t offset;
+	uint64_t* index;
+	uint32_t index_size;
+	uint64_t raw_bytes;						//int16_t sample bytes received
+	uint64_t stored_bytes;					//sample bytes after packing or compression
+	double codec_time;						//time spent packing or compressing [s]
+} CaptureFile;
+
+typedef struct
+{
+	int fd;
+	uint8_t* base;
+	size_t size;
+	CaptureHeader* header;
+	uint64_t* index;
+	int is_recovered;						//file had no trailer or a bad index, index rebuilt by walking the chunks
+	uint32_t n_chunks;
+	uint32_t n_ramps;
+	uint32_t ramp_bytes;
+} CaptureMap;
+
+uint32_t captureCrc(uint32_t crc, const void* data, size_t length);
+uint32_t captureRampBytes(const CaptureHeader* header);
+const char* sampleFormatName(uint32_t sample_format);
+
+int  openCaptureFile(CaptureFile* capture, const char* filename, CaptureHeader* header);
+int  attachCaptureFile(CaptureFile* capture, FILE* file, CaptureHeader* header);
+int  appendCaptureRamp(CaptureFile* capture, const int16_t* samples, const RampMeta* meta);
+int  closeCaptureFile(CaptureFile* capture);
+
+int  mapCapture(CaptureMap* map, const char* filename);
+void unmapCapture(CaptureMap* map);
+CaptureChunkHeader* getCaptureChunk(CaptureMap* map, uint32_t chunk);
+void* getCaptureRamp(CaptureMap* map, uint32_t ramp, RampMeta** meta);
+int  readCaptureRamp(CaptureMap* map, uint32_t ramp, int16_t* samples, RampMeta** meta);
+int  checkCaptureChunk(CaptureMap* map, uint32_t chunk);
+
+#endif
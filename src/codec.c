@@ -0,0 +1,228 @@
+#include "codec.h"
+
+typedef struct
+{
+	uint8_t* out;
+	uint64_t acc;
+	int n_bits;
+} BitWriter;
+
+typedef struct
+{
+	const uint8_t* in;
+	const uint8_t* end;
+	uint64_t acc;
+	int n_bits;
+	int n_padded;							//zero bytes read past the end
+} BitReader;
+
+
+//little-endian bit stream, value must fit into n_bits <= 32
+static inline void putBits(BitWriter* writer, uint32_t value, int n_bits)
+{
+	writer->acc |= (uint64_t)value << writer->n_bits;
+	writer->n_bits += n_bits;
+	
+	while (writer->n_bits >= 8)
+	{
+		*writer->out++ = writer->acc;
+		writer->acc >>= 8;
+		writer->n_bits -= 8;
+	}
+}
+
+
+static inline void refillBits(BitReader* reader)
+{
+	while (reader->n_bits <= 56)
+	{
+		uint64_t byte = 0;
+		
+		if (reader->in < reader->end)
+			byte = *reader->in++;
+		else
+			reader->n_padded++;
+		
+		reader->acc |= byte << reader->n_bits;
+		reader->n_bits += 8;
+	}
+}
+
+
+static inline uint32_t getBits(BitReader* reader, int n_bits)
+{
+	refillBits(reader);
+	
+	uint32_t value = reader->acc & ((1ULL << n_bits) - 1);
+	reader->acc >>= n_bits;
+	reader->n_bits -= n_bits;
+	
+	return value;
+}
+
+
+static inline uint32_t zigzag(int32_t residual)
+{
+	return ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+}
+
+
+static inline int32_t unzigzag(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+
+static inline int32_t predict(const int16_t* samples, uint32_t i, int predictor)
+{
+	if (predictor == CODEC_LPC2)
+		return 2*samples[i - 1] - samples[i - 2];
+	
+	return samples[i - 1];
+}
+
+
+//size of the output buffer required by encodeRamp, the encoder may overrun the raw
+//frame size by up to one block before it falls back to a raw frame
+size_t encodedBound(uint32_t n_samples)
+{
+	return sizeof(CodecFrameHeader) + n_samples*sizeof(int16_t) + CODEC_MAX_BLOCK_BYTES;
+}
+
+
+//returns the number of bytes in the frame, never more than the raw frame size
+size_t encodeRamp(const int16_t* samples, uint32_t n_samples, uint8_t* frame)
+{
+	CodecFrameHeader* header = (CodecFrameHeader*)frame;
+	size_t raw_bytes = sizeof(CodecFrameHeader) + n_samples*sizeof(int16_t);
+	
+	memset(header, 0, sizeof(CodecFrameHeader));
+	header->n_samples = n_samples;
+	header->warmup[0] = (n_samples > 0) ? samples[0] : 0;
+	header->warmup[1] = (n_samples > 1) ? samples[1] : 0;
+	
+	//pick the predictor with the smaller residual energy
+	uint64_t sum_delta = 0;
+	uint64_t sum_lpc2 = 0;
+	
+	for (uint32_t i = 2; i < n_samples; i++)
+	{
+		sum_delta += zigzag(samples[i] - predict(samples, i, CODEC_DELTA));
+		sum_lpc2 += zigzag(samples[i] - predict(samples, i, CODEC_LPC2));
+	}
+	
+	header->predictor = (sum_lpc2 < sum_delta) ? CODEC_LPC2 : CODEC_DELTA;
+	
+	//the encoder bails out once the frame is no smaller than the raw frame
+	uint8_t* limit = frame + raw_bytes;
+	BitWriter writer = {frame + sizeof(CodecFrameHeader), 0, 0};
+	uint32_t residuals[CODEC_BLOCK_SAMPLES];
+	
+	for (uint32_t start = 2; start < n_samples && writer.out < limit; start += CODEC_BLOCK_SAMPLES)
+	{
+		uint32_t n_block = (n_samples - start < CODEC_BLOCK_SAMPLES) ? n_samples - start : CODEC_BLOCK_SAMPLES;
+		uint32_t sum = 0;
+		int k = 0;
+		
+		for (uint32_t i = 0; i < n_block; i++)
+		{
+			residuals[i] = zigzag(samples[start + i] - predict(samples, start + i, header->predictor));
+			sum += residuals[i];
+		}
+		
+		//rice parameter close to log2 of the mean residual
+		while ((k < CODEC_MAX_RICE) && ((n_block << (k + 1)) <= sum))
+			k++;
+		
+		putBits(&writer, k, 5);
+		
+		for (uint32_t i = 0; i < n_block; i++)
+		{
+			uint32_t q = residuals[i] >> k;
+			
+			if (q < CODEC_ESCAPE)
+			{
+				putBits(&writer, 1U << q, q + 1);
+				putBits(&writer, residuals[i] & ((1U << k) - 1), k);
+			}
+			else
+			{
+				putBits(&writer, 0, CODEC_ESCAPE);
+				putBits(&writer, residuals[i], CODEC_ESCAPE_BITS);
+			}
+		}
+	}
+	
+	if (writer.n_bits > 0)
+		putBits(&writer, 0, 8 - writer.n_bits);
+	
+	if (writer.out >= limit)
+	{
+		header->predictor = CODEC_RAW;
+		memcpy(frame + sizeof(CodecFrameHeader), samples, n_samples*sizeof(int16_t));
+		return raw_bytes;
+	}
+	
+	return writer.out - frame;
+}
+
+
+//returns 1 on success, 0 if the frame is truncated or corrupt
+int decodeRamp(const uint8_t* frame, size_t frame_bytes, int16_t* samples, uint32_t n_samples)
+{
+	const CodecFrameHeader* header = (const CodecFrameHeader*)frame;
+	
+	if (frame_bytes < sizeof(CodecFrameHeader) || header->n_samples != n_samples)
+		return 0;
+	
+	if (header->predictor != CODEC_RAW && header->predictor != CODEC_DELTA && header->predictor != CODEC_LPC2)
+		return 0;
+	
+	if (header->predictor == CODEC_RAW)
+	{
+		if (frame_bytes < sizeof(CodecFrameHeader) + n_samples*sizeof(int16_t))
+			return 0;
+		
+		memcpy(samples, frame + sizeof(CodecFrameHeader), n_samples*sizeof(int16_t));
+		return 1;
+	}
+	
+	if (n_samples > 0) samples[0] = header->warmup[0];
+	if (n_samples > 1) samples[1] = header->warmup[1];
+	
+	BitReader reader = {frame + sizeof(CodecFrameHeader), frame + frame_bytes, 0, 0, 0};
+	
+	for (uint32_t start = 2; start < n_samples; start += CODEC_BLOCK_SAMPLES)
+	{
+		uint32_t n_block = (n_samples - start < CODEC_BLOCK_SAMPLES) ? n_samples - start : CODEC_BLOCK_SAMPLES;
+		int k = getBits(&reader, 5);
+		
+		if (k > CODEC_MAX_RICE)
+			return 0;
+		
+		for (uint32_t i = start; i < start + n_block; i++)
+		{
+			uint32_t value;
+			
+			refillBits(&reader);
+			
+			if ((reader.acc & ((1U << CODEC_ESCAPE) - 1)) == 0)
+			{
+				getBits(&reader, CODEC_ESCAPE);
+				value = getBits(&reader, CODEC_ESCAPE_BITS);
+			}
+			else
+			{
+				int q = __builtin_ctzll(reader.acc);
+				reader.acc >>= q + 1;
+				reader.n_bits -= q + 1;
+				value = ((uint32_t)q << k) | getBits(&reader, k);
+			}
+			
+			samples[i] = predict(samples, i, header->predictor) + unzigzag(value);
+		}
+	}
+	
+	//the zero padding past the end must not have been consumed
+	return 8*reader.n_padded <= reader.n_bits;
+}
@@ -0,0 +1,36 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+//lossless per-ramp compression
+//every ramp is coded as an independent frame: a CodecFrameHeader followed by
+//rice coded prediction residuals. residuals are coded in blocks of
+//CODEC_BLOCK_SAMPLES, each block starting with its 5-bit rice parameter.
+//frames that would not shrink are stored raw.
+
+#define CODEC_BLOCK_SAMPLES		32
+#define CODEC_ESCAPE			24			//unary length that escapes to a raw residual
+#define CODEC_ESCAPE_BITS		20			//bits of a raw residual
+#define CODEC_MAX_RICE			19			//largest rice parameter
+#define CODEC_MAX_BLOCK_BYTES	((5 + CODEC_BLOCK_SAMPLES*(CODEC_ESCAPE + CODEC_ESCAPE_BITS))/8 + 1)
+
+#define CODEC_RAW				0			//int16_t samples, no prediction
+#define CODEC_DELTA				1			//x[n] - x[n-1]
+#define CODEC_LPC2				2			//x[n] - (2x[n-1] - x[n-2])
+
+typedef struct
+{
+	uint16_t n_samples;
+	uint8_t predictor;						//CODEC_* predictor
+	uint8_t reserved;
+	int16_t warmup[2];						//first samples, stored verbatim
+} CodecFrameHeader;
+
+size_t encodedBound(uint32_t n_samples);
+size_t encodeRamp(const int16_t* samples, uint32_t n_samples, uint8_t* frame);
+int    decodeRamp(const uint8_t* frame, size_t frame_bytes, int16_t* samples, uint32_t n_samples);
+
+#endif
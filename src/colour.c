@@ -2,7 +2,7 @@
 
 void cprint(const char* text, int attr, int fg) 
 {
-	char command[13];	
+	char command[32];	
 	
 	sprintf(command, "%c[%d;%dm", 0x1B, attr, fg + 30);
 	printf("%s", command);
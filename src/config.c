@@ -0,0 +1,234 @@
+#include "config.h"
+
+//parsing both ramp files and the register template takes a noticeable part of
+//startup. the result is a pure function of the three input files, so the final
+//register images and ramp parameters are cached under a hash of their contents
+//and restored with a single read. editing any input changes the key and the
+//configuration is compiled again.
+
+
+//fnv-1a over the contents of a file, 0 if it cannot be read
+static int hashFile(const char* filename, uint64_t* hash)
+{
+	char buffer[4096];
+	int n;
+	int fd = open(filename, O_RDONLY);
+	
+	if (fd < 0)
+		return 0;
+	
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			*hash ^= (uint8_t)buffer[i];
+			*hash *= 0x100000001b3ULL;
+		}
+	}
+	
+	//separate the files so that moving bytes between them changes the key
+	*hash ^= 0xff;
+	*hash *= 0x100000001b3ULL;
+	
+	close(fd);
+	
+	return (n == 0);
+}
+
+
+static uint64_t hashInputs(Synthesizer* synthOne, Synthesizer* synthTwo)
+{
+	char filename[CONFIG_PATH_SIZE];
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	
+	snprintf(filename, sizeof(filename), "ramps/%s", synthOne->parameterFile);
+	if (!hashFile(filename, &hash))
+		return 0;
+	
+	snprintf(filename, sizeof(filename), "ramps/%s", synthTwo->parameterFile);
+	if (!hashFile(filename, &hash))
+		return 0;
+	
+	if (!hashFile(CONFIG_TEMPLATE, &hash))
+		return 0;
+	
+	return hash;
+}
+
+
+//parse the ramp files and build the register images, as loadSynths always did
+static void compileSynths(Experiment* experiment, Synthesizer* synthOne, Synthesizer* synthTwo)
+{
+	//get parameters for ini files
+	getParameters(synthOne);
+	getParameters(synthTwo);
+
+	//calculate additional ramp parameters
+	calculateRampParameters(synthOne, experiment);
+	calculateRampParameters(synthTwo, experiment);
+
+	//convert necessary values to binary
+	generateBinValues(synthOne);
+	generateBinValues(synthTwo);
+
+	//both synths start from the same template, read it once
+	readTemplateFile(CONFIG_TEMPLATE, synthOne);
+	memcpy(synthTwo->binaryRegisterArray, synthOne->binaryRegisterArray, sizeof(synthOne->binaryRegisterArray));
+
+	//insert calculated ramp parameters into register array
+	insertRampParameters(synthOne);
+	insertRampParameters(synthTwo);
+}
+
+
+//repeat the ramp table and limit warnings of calculateRampParameters for a cache hit in debug mode,
+//on scratch copies so the restored synths are untouched. without -d the limit warnings only
+//appear when the configuration is compiled
+static void reportSynths(Experiment* experiment, const Synthesizer* synthOne, const Synthesizer* synthTwo)
+{
+	static Synthesizer scratch[2];
+	
+	memset(scratch, 0, sizeof(scratch));
+	scratch[0].number = synthOne->number;
+	scratch[0].parameterFile = synthOne->parameterFile;
+	scratch[1].number = synthTwo->number;
+	scratch[1].parameterFile = synthTwo->parameterFile;
+	
+	for (int s = 0; s < 2; s++)
+	{
+		getParameters(&scratch[s]);
+		calculateRampParameters(&scratch[s], experiment);
+	}
+}
+
+
+static void storeSynth(CompiledSynth* compiled, Synthesizer* synth)
+{
+	compiled->fractional_numerator = synth->fractionalNumerator;
+	
+	for (int i = 0; i < MAX_RAMPS; i++)
+	{
+		compiled->ramps[i].reset = synth->ramps[i].reset;
+		compiled->ramps[i].next = synth->ramps[i].next;
+		compiled->ramps[i].trigger = synth->ramps[i].trigger;
+		compiled->ramps[i].flag = synth->ramps[i].flag;
+		compiled->ramps[i].doubler = synth->ramps[i].doubler;
+		compiled->ramps[i].length = synth->ramps[i].length;
+		compiled->ramps[i].next_trigger_reset = synth->ramps[i].nextTriggerReset;
+		compiled->ramps[i].bandwidth = synth->ramps[i].bandwidth;
+		compiled->ramps[i].increment = synth->ramps[i].increment;
+	}
+	
+	memcpy(compiled->register_array, synth->binaryRegisterArray, sizeof(compiled->register_array));
+}
+
+
+static void restoreSynth(Synthesizer* synth, const CompiledSynth* compiled)
+{
+	synth->fractionalNumerator = compiled->fractional_numerator;
+	
+	for (int i = 0; i < MAX_RAMPS; i++)
+	{
+		synth->ramps[i].number = i;
+		synth->ramps[i].reset = compiled->ramps[i].reset;
+		synth->ramps[i].next = compiled->ramps[i].next;
+		synth->ramps[i].trigger = compiled->ramps[i].trigger;
+		synth->ramps[i].flag = compiled->ramps[i].flag;
+		synth->ramps[i].doubler = compiled->ramps[i].doubler;
+		synth->ramps[i].length = compiled->ramps[i].length;
+		synth->ramps[i].nextTriggerReset = compiled->ramps[i].next_trigger_reset;
+		synth->ramps[i].bandwidth = compiled->ramps[i].bandwidth;
+		synth->ramps[i].increment = compiled->ramps[i].increment;
+	}
+	
+	memcpy(synth->binaryRegisterArray, compiled->register_array, sizeof(synth->binaryRegisterArray));
+}
+
+
+//write to a temporary file and rename, so a half written cache is never read
+static void storeConfiguration(const char* directory, const char* filename, const CompiledConfig* config)
+{
+	char temporary[CONFIG_NAME_SIZE + 4];
+	
+	snprintf(temporary, sizeof(temporary), "%s.tmp", filename);
+	
+	if (mkdir(directory, 0755) && errno != EEXIST)
+		return;
+	
+	int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	
+	if (fd < 0)
+		return;
+	
+	int is_ok = (write(fd, config, sizeof(CompiledConfig)) == sizeof(CompiledConfig));
+	close(fd);
+	
+	if (!is_ok || rename(temporary, filename))
+		unlink(temporary);
+}
+
+
+//fill both synths from the cache or compile them, returns 1 on a cache hit
+int loadConfiguration(Experiment* experiment, Synthesizer* synthOne, Synthesizer* synthTwo)
+{
+	static CompiledConfig config;
+	char directory[CONFIG_PATH_SIZE];
+	char filename[CONFIG_NAME_SIZE];
+	
+	uint64_t key = hashInputs(synthOne, synthTwo);
+	
+	//unreadable inputs are reported by getParameters and readTemplateFile
+	if (!key)
+	{
+		compileSynths(experiment, synthOne, synthTwo);
+		return 0;
+	}
+	
+	//a truncated path could name another configuration's file, do without the cache
+	if ((snprintf(directory, sizeof(directory), "%s/%s", experiment->storageDir, CONFIG_CACHE_DIR) >= (int)sizeof(directory)) ||
+		(snprintf(filename, sizeof(filename), "%s/%016" PRIx64 ".cfg", directory, key) >= (int)sizeof(filename)))
+	{
+		compileSynths(experiment, synthOne, synthTwo);
+		return 0;
+	}
+	
+	int fd = open(filename, O_RDONLY);
+	
+	if (fd >= 0)
+	{
+		int is_valid = (read(fd, &config, sizeof(config)) == sizeof(config)) && 
+			(config.magic == CONFIG_MAGIC) && (config.size == sizeof(config)) && 
+			(config.key == key) && !strncmp(config.version, VERSION, sizeof(config.version));
+		
+		close(fd);
+		
+		if (is_valid)
+		{
+			restoreSynth(synthOne, &config.synth[0]);
+			restoreSynth(synthTwo, &config.synth[1]);
+			
+			if (experiment->is_debug_mode)
+			{
+				cprint("[**] ", BRIGHT, CYAN);
+				printf("Configuration loaded from %s\n", filename);
+				reportSynths(experiment, synthOne, synthTwo);
+			}
+			
+			return 1;
+		}
+	}
+	
+	compileSynths(experiment, synthOne, synthTwo);
+	
+	memset(&config, 0, sizeof(config));
+	config.magic = CONFIG_MAGIC;
+	config.size = sizeof(config);
+	config.key = key;
+	strncpy(config.version, VERSION, sizeof(config.version) - 1);
+	storeSynth(&config.synth[0], synthOne);
+	storeSynth(&config.synth[1], synthTwo);
+	
+	storeConfiguration(directory, filename, &config);
+	
+	return 0;
+}
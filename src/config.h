@@ -0,0 +1,50 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "controller.h"
+
+#define CONFIG_TEMPLATE		"template/register_template.txt"
+#define CONFIG_CACHE_DIR	".rpc_cache"		//created in the storage directory, the rootfs is read-only
+#define CONFIG_MAGIC		0x47464352			//"RCFG"
+#define CONFIG_PATH_SIZE	200
+#define CONFIG_NAME_SIZE	(CONFIG_PATH_SIZE + 22)	//directory, /, 16 hex digits, .cfg
+
+//ramp parameters after calculateRampParameters, without the hex and binary scratch arrays
+typedef struct
+{
+	uint8_t  reset;
+	uint8_t  next;
+	uint8_t  trigger;
+	uint8_t  flag;
+	uint8_t  doubler;
+	uint16_t length;
+	int      next_trigger_reset;
+	double   bandwidth;
+	double   increment;
+} CompiledRamp;
+
+typedef struct
+{
+	uint32_t fractional_numerator;
+	CompiledRamp ramps[MAX_RAMPS];
+	int register_array[NUM_REGISTERS][MAX_RAMPS];	//final register image sent by updateRegisters
+} CompiledSynth;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t size;							//sizeof(CompiledConfig), rejects caches from other builds
+	uint64_t key;							//hash of both ramp files and the register template
+	char version[12];						//rpc version that compiled the cache
+	CompiledSynth synth[2];
+} CompiledConfig;
+
+int loadConfiguration(Experiment* experiment, Synthesizer* synthOne, Synthesizer* synthTwo);
+
+#endif
@@ -1,4 +1,7 @@
+#define _GNU_SOURCE
 #include "controller.h"
+#include "plan.h"
+#include "timebase.h"
 
 //load ramp parameters from ini files
 void getParameters(Synthesizer *synth)
@@ -20,9 +23,8 @@ void getParameters(Synthesizer *synth)
 		synth->ramps[i].increment = 0;
 	}	
 	
-	char* filename = (char*)malloc(50*sizeof(char));
-	strcpy(filename, "ramps/");
-	strcat(filename, synth->parameterFile);	
+	char filename[100];
+	snprintf(filename, sizeof(filename), "ramps/%s", synth->parameterFile);
 	
 	if (ini_parse(filename, handler, synth) < 0) 
 	{
@@ -34,29 +36,35 @@ void getParameters(Synthesizer *synth)
 
 
 //handler function called for every element in the ini file
-//current implementation is inefficient, but no alternative could be found
 int handler(void* pointer, const char* section, const char* attribute, const char* value)
 {			
-	char* rampSection = (char*)malloc(50*sizeof(char));
 	Synthesizer* synth = (Synthesizer*)pointer;
+	int i;
 	
-	#define MATCH(s, n) strcmp(section, s) == 0 && strcmp(attribute, n) == 0
+	#define MATCH(n) strcmp(attribute, n) == 0
 	
-	if (MATCH("setup", "frac_num")) synth->fractionalNumerator = atoi(value);
-	
-	for(int i = 0; i < MAX_RAMPS; i++)
+	if (strcmp(section, "setup") == 0)
 	{
-		sprintf(rampSection, "ramp%i", i);
-
-		if (MATCH(rampSection, "length")) 			synth->ramps[i].length = atof(value); 
-		else if (MATCH(rampSection, "bandwidth")) 	synth->ramps[i].bandwidth = atof(value);  
-		else if (MATCH(rampSection, "increment")) 	synth->ramps[i].increment = atof(value);
-		else if (MATCH(rampSection, "next")) 		synth->ramps[i].next = atoi(value);    
-		else if (MATCH(rampSection, "trigger")) 	synth->ramps[i].trigger = atoi(value);
-		else if (MATCH(rampSection, "reset")) 		synth->ramps[i].reset = atoi(value);
-		else if (MATCH(rampSection, "flag")) 		synth->ramps[i].flag = atoi(value);	
-		else if (MATCH(rampSection, "doubler")) 	synth->ramps[i].doubler = atoi(value);	
-	}	
+		if (MATCH("frac_num")) synth->fractionalNumerator = atoi(value);
+		return 1;
+	}
+	
+	//ramp sections are named ramp0 to ramp7
+	if (strncmp(section, "ramp", 4) || section[4] < '0' || section[4] > '0' + MAX_RAMPS - 1 || section[5] != '\0')
+		return 1;
+	
+	i = section[4] - '0';
+	
+	if (MATCH("length")) 			synth->ramps[i].length = atof(value); 
+	else if (MATCH("bandwidth")) 	synth->ramps[i].bandwidth = atof(value);  
+	else if (MATCH("increment")) 	synth->ramps[i].increment = atof(value);
+	else if (MATCH("next")) 		synth->ramps[i].next = atoi(value);    
+	else if (MATCH("trigger")) 		synth->ramps[i].trigger = atoi(value);
+	else if (MATCH("reset")) 		synth->ramps[i].reset = atoi(value);
+	else if (MATCH("flag")) 		synth->ramps[i].flag = atoi(value);	
+	else if (MATCH("doubler")) 		synth->ramps[i].doubler = atoi(value);	
+	
+	#undef MATCH
 	
 	return 1;	
 }
@@ -147,17 +155,23 @@ void generateHexValues(Synthesizer *synth)
 }
 
 
+//the binary arrays are allocated on the first call and reused when the synths are reloaded
 void generateBinValues(Synthesizer *synth)
 {
-	synth->binFractionalNumerator = (int*)malloc(24*sizeof(int));
+	if (!synth->binFractionalNumerator)
+		synth->binFractionalNumerator = (int*)malloc(24*sizeof(int));
+	
 	memset(synth->binFractionalNumerator, 0, 24*sizeof(int));
 	decimalToBinary(synth->fractionalNumerator, synth->binFractionalNumerator);	
 	
 	for (int i = 0; i < 8; i++)
 	{	
-		synth->ramps[i].binIncrement     = (int*)malloc(32*sizeof(int));
-		synth->ramps[i].binLength        = (int*)malloc(16*sizeof(int));	
-		synth->ramps[i].binNextTrigReset = (int*)malloc(8*sizeof(int));		
+		if (!synth->ramps[i].binIncrement)
+		{
+			synth->ramps[i].binIncrement     = (int*)malloc(32*sizeof(int));
+			synth->ramps[i].binLength        = (int*)malloc(16*sizeof(int));	
+			synth->ramps[i].binNextTrigReset = (int*)malloc(8*sizeof(int));		
+		}
 		
 		memset(synth->ramps[i].binIncrement, 	 0, 32*sizeof(int));
 		memset(synth->ramps[i].binLength, 		 0, 16*sizeof(int));
@@ -380,31 +394,31 @@ void setRegister(Synthesizer *synth, int registerAddress, int registerValue)
 	
 	//Latch enable high
 	rp_DpinSetState(synth->latchPin, RP_HIGH);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//Clock high
 	rp_DpinSetState(synth->clockPin, RP_HIGH);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//latch enable low
 	rp_DpinSetState(synth->latchPin, RP_LOW);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//data low
 	rp_DpinSetState(synth->dataPin, RP_LOW);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//clock setup time
 	usleep(1000);
-
+	
 	//clock high
 	rp_DpinSetState(synth->clockPin, RP_HIGH);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//clock low
 	rp_DpinSetState(synth->clockPin,RP_LOW);
-	usleep(1);
-
+	spinDelay(1);
+	
 	for (int j = 15; j >= 0 ; j--)
 	{
 		//Assert address bits on data line
@@ -419,16 +433,16 @@ void setRegister(Synthesizer *synth, int registerAddress, int registerValue)
 		
 		//clock high
 		rp_DpinSetState(synth->clockPin, RP_HIGH);
-		usleep(1);
+		spinDelay(1);
 		
 		//clock low
 		rp_DpinSetState(synth->clockPin, RP_LOW);				
-		usleep(1);
+		spinDelay(1);
 	}			
 	
 	//Only do this the first loop iteration, set addressFlag
 	synth->addressFlag = 1;	
-
+	
 	//Write register data
 	for(int j = 7; j >= 0; j--)
 	{
@@ -443,17 +457,17 @@ void setRegister(Synthesizer *synth, int registerAddress, int registerValue)
 		
 		//clock high
 		rp_DpinSetState(synth->clockPin, RP_HIGH);
-		usleep(1);
+		spinDelay(1);
 		
 		//clock low
 		rp_DpinSetState(synth->clockPin, RP_LOW);
-		usleep(1);
+		spinDelay(1);
 	}
 	
 	//Latch enable high
 	rp_DpinSetState(synth->latchPin, RP_HIGH);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//data low
 	rp_DpinSetState(synth->dataPin, RP_LOW);	
 }
@@ -474,31 +488,31 @@ void updateRegisters(Synthesizer *synth)
 		{
 			//Latch enable high
 			rp_DpinSetState(synth->latchPin, RP_HIGH);
-			usleep(1);
-
+			spinDelay(1);
+			
 			//Clock high
 			rp_DpinSetState(synth->clockPin, RP_HIGH);
-			usleep(1);
-
+			spinDelay(1);
+			
 			//latch enable low
 			rp_DpinSetState(synth->latchPin, RP_LOW);
-			usleep(1);
-
+			spinDelay(1);
+			
 			//data low
 			rp_DpinSetState(synth->dataPin, RP_LOW);
-			usleep(1);
-
+			spinDelay(1);
+			
 			//clock setup time
 			usleep(1000); 
-
+			
 			//clock high
 			rp_DpinSetState(synth->clockPin, RP_HIGH);
-			usleep(1);
-
+			spinDelay(1);
+			
 			//clock low
 			rp_DpinSetState(synth->clockPin,RP_LOW);
-			usleep(1);
-
+			spinDelay(1);
+			
 			for (int j = 15; j >= 0 ; j--)
 			{
 				//Assert address bits on data line
@@ -513,17 +527,17 @@ void updateRegisters(Synthesizer *synth)
 				
 				//clock high
 				rp_DpinSetState(synth->clockPin, RP_HIGH);
-				usleep(1);
+				spinDelay(1);
 				
 				//clock low
 				rp_DpinSetState(synth->clockPin, RP_LOW);				
-				usleep(1);
+				spinDelay(1);
 			}			
 			
 			//Only do this the first loop iteration, set addressFlag
 			synth->addressFlag = 1;
 		}
-
+		
 		//Write register data
 		for(int j = 7; j >= 0; j--)
 		{
@@ -540,23 +554,23 @@ void updateRegisters(Synthesizer *synth)
 			
 			//clock high
 			rp_DpinSetState(synth->clockPin, RP_HIGH);
-			usleep(1);
+			spinDelay(1);
 			
 			//clock low
 			rp_DpinSetState(synth->clockPin, RP_LOW);
-			usleep(1);
+			spinDelay(1);
 		}
 	}
 	
 	//Latch enable high
 	rp_DpinSetState(synth->latchPin, RP_HIGH);
-	usleep(1);
-
+	spinDelay(1);
+	
 	//data low
 	rp_DpinSetState(synth->dataPin, RP_LOW);
 }
- 
- 
+
+
 void initRP(void)
 {
 	// Initialization of API
@@ -581,7 +595,7 @@ void triggerSynthesizers(Synthesizer *synthOne, Synthesizer *synthTwo)
 	//Trigger
 	rp_DpinSetState(synthOne->trigPin, RP_LOW);
 	rp_DpinSetState(synthTwo->trigPin, RP_LOW);	
-	usleep(1);	
+	spinDelay(1);	
 	rp_DpinSetState(synthTwo->trigPin, RP_HIGH);
 	rp_DpinSetState(synthOne->trigPin, RP_HIGH);
 }
@@ -596,9 +610,16 @@ void parallelTrigger(Synthesizer *synthOne, Synthesizer *synthTwo)
 	getchar();
 	getchar();
 	
+	pulseTrigger(synthOne, synthTwo);
+}
+
+
+//trigger both synths on the same rising edge
+void pulseTrigger(Synthesizer *synthOne, Synthesizer *synthTwo)
+{
 	//Rising edge required
 	setpins(synthOne->trigPin - RP_DIO0_N, 0, synthTwo->trigPin - RP_DIO0_N, 0, 0x4000001C);
-	usleep(1);
+	spinDelay(1);
 	setpins(synthOne->trigPin - RP_DIO0_N, 1, synthTwo->trigPin - RP_DIO0_N, 1, 0x4000001C);
 }
 
@@ -606,51 +627,71 @@ void parallelTrigger(Synthesizer *synthOne, Synthesizer *synthTwo)
 void configureVerbose(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo)
 {
 	char userin;	
-
+	
 	do
 	{  
 		cprint("[??] ", BRIGHT, BLUE);
 		printf("Ramps: ");	    
 	} while (((scanf("%d%c", &experiment->n_ramps, &userin)!=2 || userin!='\n') && clean_stdin()));
 	
-	experiment->outputSize = (16*experiment->n_ramps*(experiment->ns_ext_buffer + experiment->ns_ref_buffer))/(8*1e6);		
+	cprint("[??] ", BRIGHT, BLUE);
+	printf("Comment [140]: ");
+	char comment[140];
+	scanf("%[^\n]s", comment);
+	
+	configureExperiment(experiment, synthOne, synthTwo, comment);
+}
 
-	//read-write mode
-	system("rw\n");
 
-	//create time-stamped folder
-	char syscmd[100];
-	char foldername[100];
-	experiment->timeStamp = (char*)malloc(20*sizeof(char));
+//create the experiment folder, output filenames and summary without prompting
+void configureExperiment(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo, const char* comment)
+{
+	//packed samples use 14 of every 16 bits, compressed output is bounded by the raw size
+	double bits_per_sample = (experiment->sample_format == SAMPLE_FORMAT_PACK14) ? 14 : 16;
+	experiment->outputSize = (bits_per_sample*experiment->n_ramps*(experiment->ns_ext_buffer + experiment->ns_ref_buffer))/(8*1e6);		
 	
-	time_t rawtime = time(NULL);
-	struct tm tm = *localtime(&rawtime);
+	//remount the rootfs read-write only if the storage directory is not writable
+	if (access(experiment->storageDir, W_OK))
+		mount(NULL, RP_SYSTEM_PATH, NULL, MS_REMOUNT, NULL);
 	
-	sprintf(experiment->timeStamp, "%02d_%02d_%02d_%02d_%02d_%02d", tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900 - 2000, tm.tm_hour, tm.tm_min, tm.tm_sec);
-	sprintf(foldername, "%s/%s/", experiment->storageDir, experiment->timeStamp);
-	sprintf(syscmd, "mkdir %s/%s", experiment->storageDir, experiment->timeStamp);		
-	system(syscmd);
+	//create time-stamped folder
+	char source[100];
+	char foldername[PATH_SIZE - 16];			//room for the longest file name
 	
-	char* ch1_out = (char*)malloc(100*sizeof(char));
-	strcpy(ch1_out, foldername);
-	strcat(ch1_out, "ext.bin");
+	//utc like the summary, gps referenced once the timebase is locked
+	struct tm tm;
+	utcTime(monotonicTime(), &tm);
 	
-	char* ch2_out = (char*)malloc(100*sizeof(char));
-	strcpy(ch2_out, foldername);
-	strcat(ch2_out, "ref.bin");
+	strftime(experiment->timeStamp, STAMP_SIZE, "%d_%m_%y_%H_%M_%S", &tm);
 	
-	char* imu_out = (char*)malloc(100*sizeof(char));
-	strcpy(imu_out, foldername);
-	strcat(imu_out, "imu.bin");	
+	//back to back collections can start within the same second
+	for (int n = 1; n < 100; n++)
+	{
+		snprintf(foldername, sizeof(foldername), "%s/%s", experiment->storageDir, experiment->timeStamp);
+		
+		if (access(foldername, F_OK))
+			break;
+		
+		sprintf(experiment->timeStamp + 17, "_%i", n);
+	}
 	
-	char* summary = (char*)malloc(100*sizeof(char));
-	strcpy(summary, foldername);
-	strcat(summary, "summary.ini");	
+	snprintf(foldername, sizeof(foldername), "%s/%s/", experiment->storageDir, experiment->timeStamp);
 	
-	experiment->ch1_filename = ch1_out;
-	experiment->ch2_filename = ch2_out;
-	experiment->imu_filename = imu_out;
-	experiment->summary_filename = summary;
+	if (mkdir(foldername, 0755))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not create %s: %s\n", foldername, strerror(errno));
+	}
+	
+	//the names live in the experiment, so repeated collections of the daemon and schedules do not allocate
+	snprintf(experiment->ch1_filename, PATH_SIZE, "%sext.cap", foldername);
+	snprintf(experiment->ch2_filename, PATH_SIZE, "%sref.bin", foldername);
+	snprintf(experiment->imu_filename, PATH_SIZE, "%simu.bin", foldername);
+	snprintf(experiment->pose_filename, PATH_SIZE, "%spose.bin", foldername);
+	snprintf(experiment->samples_filename, PATH_SIZE, "%simu_samples.bin", foldername);
+	snprintf(experiment->summary_filename, PATH_SIZE, "%ssummary.ini", foldername);
+	snprintf(experiment->log_filename, PATH_SIZE, "%srpc.log", foldername);
+	snprintf(experiment->trace_filename, PATH_SIZE, "%strace.json", foldername);
 	
 	FILE* summaryFile;
 	summaryFile = fopen(experiment->summary_filename, "w");
@@ -664,36 +705,43 @@ void configureVerbose(Experiment *experiment, Synthesizer *synthOne, Synthesizer
 	else
     {
 		//copy ini parameter files
-		sprintf(syscmd, "cp ramps/%s %s", synthOne->parameterFile, foldername);
-		system(syscmd);
+		sprintf(source, "ramps/%s", synthOne->parameterFile);
+		if (!copyFile(source, foldername))
+		{
+			cprint("[!!] ", BRIGHT, RED);
+			printf("Could not copy %s to %s: %s\n", source, foldername, strerror(errno));
+		}
 		
-		if (synthOne->parameterFile != synthTwo->parameterFile)
+		if (strcmp(synthOne->parameterFile, synthTwo->parameterFile))
 		{
-			sprintf(syscmd, "cp ramps/%s %s", synthTwo->parameterFile, foldername); 
-			system(syscmd);
+			sprintf(source, "ramps/%s", synthTwo->parameterFile);
+			if (!copyFile(source, foldername))
+			{
+				cprint("[!!] ", BRIGHT, RED);
+				printf("Could not copy %s to %s: %s\n", source, foldername, strerror(errno));
+			}
 		}
 		
 		//print summary file 
 		fprintf(summaryFile, "[overview]\r\n");
 		fprintf(summaryFile, "timestamp = %s\r\n", experiment->timeStamp);
 		fprintf(summaryFile, "rpc_version = %s\r\n", VERSION);
-		
-		cprint("[??] ", BRIGHT, BLUE);
-		printf("Comment [140]: ");
-		char userin[140];
-		scanf("%[^\n]s", userin);
-		
-		fprintf(summaryFile, "comment = %s\r\n", userin);
+		fprintf(summaryFile, "comment = %s\r\n", comment);
 		
 		fprintf(summaryFile, "\n[dataset]\r\n");
 		fprintf(summaryFile, "storage_directory = %s\r\n", experiment->ch1_filename);
 		fprintf(summaryFile, "decimation_factor = %d\r\n", experiment->decFactor);
 		fprintf(summaryFile, "sampling_rate =  %.2f\r\n", 125e6/experiment->decFactor);
 		fprintf(summaryFile, "n_ramps = %i\r\n", experiment->n_ramps);			
+		fprintf(summaryFile, "samples_per_ramp = %i\r\n", experiment->ns_ext_buffer);			
+		fprintf(summaryFile, "container_version = %i\r\n", CAPTURE_VERSION);			
+		fprintf(summaryFile, "chunk_ramps = %i\r\n", CAPTURE_CHUNK_RAMPS);			
+		fprintf(summaryFile, "sample_format = %s\r\n", sampleFormatName(experiment->sample_format));			
 		
 		fprintf(summaryFile, "\n[synth_one]\r\n");
 		fprintf(summaryFile, "frequency_offset = %.3f\r\n", vcoOut(synthOne->fractionalNumerator));
 		fprintf(summaryFile, "fractional_numerator = %d\r\n", synthOne->fractionalNumerator);		
+		writeSweepSummary(summaryFile, synthOne);
 		fprintf(summaryFile, "| NUM | NXT | RST | DBL |   LEN |            INC |      BNW |\r\n");		
 		
 		for (int k = 0; k<8; k++)
@@ -709,6 +757,7 @@ void configureVerbose(Experiment *experiment, Synthesizer *synthOne, Synthesizer
 		fprintf(summaryFile, "\n[synth_two]\r\n");
 		fprintf(summaryFile, "frequency_offset = %.3f\r\n", vcoOut(synthTwo->fractionalNumerator));
 		fprintf(summaryFile, "fractional_numerator = %d\r\n", synthTwo->fractionalNumerator);		
+		writeSweepSummary(summaryFile, synthTwo);
 		fprintf(summaryFile, "| NUM | NXT | RST | DBL |   LEN |            INC |      BNW |\r\n");
 		
 		for (int j = 0; j<8; j++)
@@ -720,12 +769,27 @@ void configureVerbose(Experiment *experiment, Synthesizer *synthOne, Synthesizer
 				synthTwo->ramps[j].increment, bnwOut(synthTwo->ramps[j].increment, synthTwo->ramps[j].length));	
 			}	
 		}      
-
+		
 		fclose(summaryFile);
 	}	
 }
 
 
+//reopen the summary file to record results that are only known once the run is complete
+FILE* appendSummary(Experiment *experiment)
+{
+	FILE* summaryFile = fopen(experiment->summary_filename, "a");
+	
+	if (summaryFile == 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not append to summary file.\n");
+	}
+	
+	return summaryFile;
+}
+
+
 void generateClock(void)
 {
 	//system("generate 1 1 50000000 sine");
@@ -764,10 +828,56 @@ double elapsed_us(struct timeval start_time, struct timeval end_time)
 	return ((double)end_time.tv_sec - (double)start_time.tv_sec)*1e6 + ((double)end_time.tv_usec - (double)start_time.tv_usec);
 }
 
+//copy a file into a directory (with trailing /), returns 0 on failure
+int copyFile(const char* source, const char* directory)
+{
+	char destination[200];
+	char buffer[4096];
+	const char* name = strrchr(source, '/');
+	int n, is_ok = 1;
+	
+	snprintf(destination, sizeof(destination), "%s%s", directory, name ? name + 1 : source);
+	
+	int in = open(source, O_RDONLY);
+	int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	
+	if (in < 0 || out < 0)
+		is_ok = 0;
+	
+	while (is_ok && (n = read(in, buffer, sizeof(buffer))) > 0)
+		is_ok = (write(out, buffer, n) == n);
+	
+	if (in >= 0) close(in);
+	if (out >= 0) close(out);
+	
+	return is_ok;
+}
 
 
+//busy wait for short delays where usleep would sleep for tens of microseconds
+void spinDelay(int us)
+{
+	double t_end = monotonicTime() + us*1e-6;
+	
+	while (monotonicTime() < t_end);
+}
 
 
+//seconds on the raw monotonic clock, used to timestamp ramps and imu samples
+double monotonicTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	
+	return (double)now.tv_sec + (double)now.tv_nsec*1e-9;
+}
 
-
-
+//restrict a thread to a single core
+int pinThread(pthread_t thread, int cpu)
+{
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	
+	return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+}
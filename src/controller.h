@@ -8,16 +8,27 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mount.h>
 
 #include "rp.h"
 #include "mon.h"
 #include "colour.h"
 #include "ini.h"
+#include "capture.h"
 
-#define VERSION "2.2.0"
+#define VERSION "2.3.0"
 #define MAX_RAMPS 8
 #define NUM_REGISTERS 142
 #define ADC_RATE 125e6
+#define ACQ_CPU 0
+#define AUX_CPU 1
+#define RP_SYSTEM_PATH "/opt/redpitaya"
+#define STAMP_SIZE 24
+#define PATH_SIZE 128
 
 typedef struct 
 {
@@ -62,18 +73,34 @@ typedef struct
 	int is_debug_mode;					//is debug mode enabled
 	int adc_channel;					//adc channel to record on
 	int decFactor; 						//adc decimation factor
+	int sample_format;					//on-disk sample format, SAMPLE_FORMAT_*
 	int u_max_loop;		 				//maximum loop period in microseconds
 	int n_flags;						//number of flags detected
 	int n_corrupt;						//number of ramps which contain partly new and partly old data
 	int n_missed;						//number of flags missed 
 	int n_ramps;						//number of ramps to be recorded
 	char* storageDir; 					//path to storage directory
-	char* timeStamp;					//experiment timestamp
-	char* ch1_filename; 				//filename of output data including path
-	char* ch2_filename; 				//filename of output data including path
-	char* imu_filename; 				//filename of output data including path
-	char* summary_filename; 			//filename of summary file including path
+	char timeStamp[STAMP_SIZE];			//experiment timestamp
+	char ch1_filename[PATH_SIZE];		//filename of output data including path
+	char ch2_filename[PATH_SIZE];		//filename of output data including path
+	char imu_filename[PATH_SIZE];		//filename of output data including path
+	char* uart_device;					//serial port of the um7
+	char pose_filename[PATH_SIZE];		//filename of per-ramp pose records including path
+	char samples_filename[PATH_SIZE];	//filename of decoded imu samples including path
+	char summary_filename[PATH_SIZE];	//filename of summary file including path
+	char log_filename[PATH_SIZE];		//filename of the collection log including path
+	char trace_filename[PATH_SIZE];		//filename of the pipeline trace including path
 	double_t outputSize; 				//recoring size [MB]
+	double t_start;						//trigger time of the first ramp [s, CLOCK_MONOTONIC_RAW]
+	double segment_size;				//roll over to a new ext segment after this size [MB], 0 for unlimited
+	int segment_ramps;					//roll over to a new ext segment after this many ramps, 0 for unlimited
+	int is_placeholder;					//write zero ramps in place of missed triggers
+	int is_calibration;					//size the capture from a startup calibration
+	uint32_t ns_requested;				//requested samples per ramp, 0 for the largest that keeps up
+	int is_trace;						//record a timeline of the capture pipeline
+	int is_counters;					//count hardware events per pipeline phase
+	int is_preflight_forced;			//start even if the storage pre-flight check fails
+	uint32_t preview_every;				//publish every nth ramp to the shared-memory preview, 0 to disable
 	uint32_t ns_ext_buffer;				//number of samples to capture from adc on external channel
 	uint32_t ns_ref_buffer;				//number of samples to capture from adc on reference channel
 	rp_acq_trig_src_t trigger_source;  	//source for red pitaya adc trigger
@@ -98,7 +125,10 @@ void initPins(Synthesizer *synth);
 void updateRegisters(Synthesizer *synth);
 void triggerSynthesizers(Synthesizer *synthOne, Synthesizer *synthTwo);
 void parallelTrigger(Synthesizer *synthOne, Synthesizer *synthTwo);
+void pulseTrigger(Synthesizer *synthOne, Synthesizer *synthTwo);
 void configureVerbose(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo);
+void configureExperiment(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo, const char* comment);
+FILE* appendSummary(Experiment *experiment);
 void generateClock(void);
 void setRegister(Synthesizer *synth, int registerAddress, int registerValue);
 
@@ -110,5 +140,9 @@ int  clean_stdin();
 double vcoOut(uint32_t fracNum);
 double bnwOut(double rampInc, uint16_t);
 double elapsed_us(struct timeval start_time, struct timeval end_time);
+int  copyFile(const char* source, const char* directory);
+void spinDelay(int us);
+double monotonicTime(void);
+int  pinThread(pthread_t thread, int cpu);
 
 #endif
@@ -0,0 +1,201 @@
+#include "counters.h"
+#include "colour.h"
+
+//hardware performance counters per pipeline phase. every traced thread opens
+//its own perf event group, read with one syscall before and after a phase.
+//the read costs a few microseconds, so counters are an instrumentation option
+//and the loop budget is not representative while they are on. events the
+//kernel or pmu does not provide are left out, without a pmu only context
+//switches are counted, and without perf events nothing is.
+
+static const char* event_names[COUNTER_EVENTS] = {
+	"cycles", "instructions", "cache_misses", "tlb_misses", "context_switches"
+};
+
+static const struct { uint32_t type; uint64_t config; } event_types[COUNTER_EVENTS] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+	{PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}
+};
+
+static int is_counting = 0;
+static uint32_t available = 0;				//events opened by at least one thread
+static int is_reported = 0;
+static CounterPhase phases[TRACE_PHASES];	//each phase is only updated by the thread that runs it
+
+static __thread int group_fd = -1;
+static __thread int event_fds[COUNTER_EVENTS] = {-1, -1, -1, -1, -1};
+static __thread int event_slots[COUNTER_EVENTS];	//position of each event in the group read, -1 if missing
+static __thread int n_slots = 0;
+
+
+void initCounters(int is_enabled)
+{
+	is_counting = is_enabled;
+	available = 0;
+	is_reported = 0;
+	memset(phases, 0, sizeof(phases));
+}
+
+
+static int openEvent(int event, int leader, int is_user_only)
+{
+	struct perf_event_attr attr;
+	
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = event_types[event].type;
+	attr.config = event_types[event].config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_kernel = is_user_only;
+	attr.exclude_hv = 1;
+	
+	//counts the calling thread on any cpu
+	return syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+
+//open the event group of the calling thread, returns the number of events counted
+int openCounters(void)
+{
+	if (!is_counting || group_fd >= 0)
+		return n_slots;
+	
+	int is_user_only = 0;
+	int error = 0;
+	
+	n_slots = 0;
+	
+	for (int i = 0; i < COUNTER_EVENTS; i++)
+	{
+		int fd = openEvent(i, group_fd, is_user_only);
+		
+		//restricted perf_event_paranoid still allows user space counting
+		if (fd < 0 && (errno == EACCES || errno == EPERM) && !is_user_only)
+		{
+			is_user_only = 1;
+			fd = openEvent(i, group_fd, is_user_only);
+		}
+		
+		event_fds[i] = fd;
+		event_slots[i] = (fd >= 0) ? n_slots++ : -1;
+		
+		if (fd < 0)
+			error = errno;
+		else if (group_fd < 0)
+			group_fd = fd;
+		
+		if (fd >= 0)
+			__atomic_or_fetch(&available, 1 << i, __ATOMIC_RELAXED);
+	}
+	
+	if (error && !__atomic_exchange_n(&is_reported, 1, __ATOMIC_RELAXED))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Some performance counters are unavailable: %s\n", strerror(error));
+	}
+	
+	return n_slots;
+}
+
+
+void closeCounters(void)
+{
+	for (int i = 0; i < COUNTER_EVENTS; i++)
+	{
+		if (event_fds[i] >= 0)
+			close(event_fds[i]);
+		
+		event_fds[i] = -1;
+	}
+	
+	group_fd = -1;
+	n_slots = 0;
+}
+
+
+//current counts of the calling thread, returns 0 without counters
+int readCounters(CounterSample* sample)
+{
+	uint64_t group[1 + COUNTER_EVENTS];
+	
+	if (group_fd < 0)
+		return 0;
+	
+	if (read(group_fd, group, sizeof(group)) < (ssize_t)((1 + n_slots)*sizeof(uint64_t)))
+		return 0;
+	
+	for (int i = 0; i < COUNTER_EVENTS; i++)
+		sample->values[i] = (event_slots[i] >= 0) ? group[1 + event_slots[i]] : 0;
+	
+	return 1;
+}
+
+
+//add the counts since begin to phase
+void countPhase(int phase, const CounterSample* begin)
+{
+	CounterSample end;
+	
+	if (!readCounters(&end))
+		return;
+	
+	phases[phase].n_calls++;
+	
+	for (int i = 0; i < COUNTER_EVENTS; i++)
+		phases[phase].totals[i] += end.values[i] - begin->values[i];
+}
+
+
+//the counters are read outside the traced span, so the trace does not include the read
+void beginPhase(PhaseProbe* probe)
+{
+	readCounters(&probe->counters);
+	probe->t = traceTime();
+}
+
+
+void endPhase(int phase, const PhaseProbe* probe, uint32_t ramp)
+{
+	traceSpan(phase, probe->t, ramp);
+	countPhase(phase, &probe->counters);
+}
+
+
+//totals and means per call of every phase, call once the counting threads have been joined
+void writeCounterSummary(FILE* summaryFile)
+{
+	if (!is_counting)
+		return;
+	
+	fprintf(summaryFile, "\n[counters]\r\n");
+	fprintf(summaryFile, "events =");
+	
+	for (int i = 0; i < COUNTER_EVENTS; i++)
+		if (available & (1 << i))
+			fprintf(summaryFile, " %s", event_names[i]);
+	
+	fprintf(summaryFile, "\r\n");
+	
+	for (int p = 0; p < TRACE_PHASES; p++)
+	{
+		if (!phases[p].n_calls)
+			continue;
+		
+		const char* name = tracePhaseName(p);
+		
+		fprintf(summaryFile, "%s_calls = %llu\r\n", name, (unsigned long long)phases[p].n_calls);
+		
+		//total, mean per call
+		for (int i = 0; i < COUNTER_EVENTS; i++)
+		{
+			if (available & (1 << i))
+			{
+				fprintf(summaryFile, "%s_%s = %llu %.1f\r\n", name, event_names[i], (unsigned long long)phases[p].totals[i], 
+					(double)phases[p].totals[i]/phases[p].n_calls);
+			}
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "trace.h"
+
+//events counted per pipeline phase, phases are the TRACE_* ids
+enum
+{
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_TLB_MISSES,						//data tlb read misses
+	COUNTER_CONTEXT_SWITCHES,
+	COUNTER_EVENTS
+};
+
+typedef struct
+{
+	uint64_t values[COUNTER_EVENTS];
+} CounterSample;
+
+//begin of a phase for the tracer and the counters
+typedef struct
+{
+	double t;
+	CounterSample counters;
+} PhaseProbe;
+
+typedef struct
+{
+	uint64_t n_calls;
+	uint64_t totals[COUNTER_EVENTS];
+} CounterPhase;
+
+void initCounters(int is_enabled);
+int  openCounters(void);
+void closeCounters(void);
+int  readCounters(CounterSample* sample);
+void countPhase(int phase, const CounterSample* begin);
+void writeCounterSummary(FILE* summaryFile);
+
+void beginPhase(PhaseProbe* probe);
+void endPhase(int phase, const PhaseProbe* probe, uint32_t ramp);
+
+#endif
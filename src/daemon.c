@@ -0,0 +1,100 @@
+#include "daemon.h"
+
+static int server = -1;
+static const char* socket_path;
+
+
+int initDaemon(const char* path)
+{
+	struct sockaddr_un address;
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	
+	if ((server = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return 0;
+	
+	//a socket left behind by a previous daemon would make bind fail
+	unlink(path);
+	
+	if (bind(server, (struct sockaddr*)&address, sizeof(address)) || listen(server, 4))
+	{
+		close(server);
+		server = -1;
+		return 0;
+	}
+	
+	socket_path = path;
+	
+	return 1;
+}
+
+
+//wait for a client and read its command line, returns the client or -1
+int acceptCommand(char* line, int size)
+{
+	int client = accept(server, NULL, NULL);
+	int length = 0;
+	
+	if (client < 0)
+		return -1;
+	
+	//a silent client must not lock out stop and quit
+	struct timeval timeout = {DAEMON_READ_TIMEOUT, 0};
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	
+	while (length < size - 1)
+	{
+		int n = read(client, line + length, size - 1 - length);
+		
+		if (n <= 0)
+			break;
+		
+		length += n;
+		
+		if (memchr(line + length - n, '\n', n))
+			break;
+	}
+	
+	line[length] = '\0';
+	line[strcspn(line, "\r\n")] = '\0';
+	
+	return client;
+}
+
+
+void replyCommand(int client, const char* format, ...)
+{
+	char reply[DAEMON_LINE_SIZE];
+	va_list args;
+	
+	va_start(args, format);
+	int length = vsnprintf(reply, sizeof(reply) - 1, format, args);
+	va_end(args);
+	
+	if (length > (int)sizeof(reply) - 2)
+		length = sizeof(reply) - 2;
+	
+	reply[length++] = '\n';
+	
+	//the client may already be gone
+	send(client, reply, length, MSG_NOSIGNAL);
+}
+
+
+void closeCommand(int client)
+{
+	close(client);
+}
+
+
+void dnitDaemon(void)
+{
+	if (server < 0)
+		return;
+	
+	close(server);
+	unlink(socket_path);
+	server = -1;
+}
@@ -0,0 +1,31 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define DAEMON_SOCKET			"/tmp/rpc.sock"
+#define DAEMON_LINE_SIZE		256			//longest command or reply
+#define DAEMON_READ_TIMEOUT		2			//a client that sends no complete line is dropped [s]
+
+//commands, one line per connection:
+//  start <n_ramps> [comment]		start a collection, replies with the experiment folder
+//  stop							end the running collection early
+//  status							idle|running <folder> <ramps> <missed> <corrupt>
+//  config <lo.ini> <rf.ini>		load new ramp files into the synths while idle
+//  quit							stop and shut the daemon down
+//every reply starts with OK or ERR
+
+int  initDaemon(const char* path);
+int  acceptCommand(char* line, int size);
+void replyCommand(int client, const char* format, ...);
+void closeCommand(int client);
+void dnitDaemon(void);
+
+#endif
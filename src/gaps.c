@@ -0,0 +1,113 @@
+#include "gaps.h"
+
+//the capture loop only catches triggers while it is armed, so a ramp that
+//arrives during a transfer is lost without a trace. the adc write pointer wraps
+//about once per ramp and cannot count whole periods, instead each captured
+//trigger is placed on the trigger grid by its time since the first one. the
+//grid is a least squares fit of index against trigger time, so one late
+//detection only rounds that ramp and a small period error does not accumulate.
+
+static GapCounter counter;
+
+
+//period is the trigger period [s] if known, 0 to estimate it from the ramps
+void initGapCounter(double period)
+{
+	memset(&counter, 0, sizeof(GapCounter));
+	counter.period = period;
+	counter.is_calibrated = (period > 0);
+}
+
+
+static void addFit(uint32_t ramp, double t)
+{
+	double d_ramp = ramp - counter.mean_ramp;
+	double d_t = t - counter.mean_t;
+	
+	counter.n_fit++;
+	counter.mean_ramp += d_ramp/counter.n_fit;
+	counter.mean_t += d_t/counter.n_fit;
+	counter.c_ramp += d_ramp*(ramp - counter.mean_ramp);
+	counter.c_t += d_ramp*(t - counter.mean_t);
+	
+	//the calibrated period only places the second ramp, a few percent off it
+	//would open phantom gaps within a few dozen ramps
+	if (counter.c_ramp > 0)
+		counter.period = counter.c_t/counter.c_ramp;
+}
+
+
+//called from the capture loop for every captured trigger, returns the number
+//of ramps missed since the previous one and their along-track index in ramp
+uint32_t countGap(double t, uint32_t* ramp)
+{
+	if (counter.n_captured++ == 0)
+	{
+		counter.t_first = counter.t_last = t;
+		addFit(0, 0);
+		*ramp = counter.ramp = 0;
+		return 0;
+	}
+	
+	double interval = t - counter.t_last;
+	
+	//the first interval seeds the estimate
+	if (counter.period <= 0)
+		counter.period = interval;
+	
+	//shorter than one period early on, the estimate was taken over a gap
+	if (!counter.is_calibrated && counter.n_fit < GAP_PERIOD_WINDOW && interval < 0.5*counter.period)
+	{
+		counter.period = interval;
+		counter.n_fit = 0;
+		counter.mean_ramp = counter.mean_t = counter.c_ramp = counter.c_t = 0;
+		addFit(counter.ramp, counter.t_last - counter.t_first);
+	}
+	
+	long n = lround(counter.mean_ramp + (t - counter.t_first - counter.mean_t)/counter.period) - (long)counter.ramp;
+	
+	//an edge on the index already taken, e.g. a second edge from one trigger
+	if (n < 1)
+	{
+		counter.n_repeats++;
+		*ramp = counter.ramp;
+		return 0;
+	}
+	
+	uint32_t gap = n - 1;
+	
+	if (gap > 0)
+	{
+		counter.n_missed += gap;
+		counter.n_gaps++;
+		
+		if (gap > counter.max_gap)
+			counter.max_gap = gap;
+	}
+	
+	counter.ramp += n;
+	counter.t_last = t;
+	addFit(counter.ramp, t - counter.t_first);
+	*ramp = counter.ramp;
+	
+	return gap;
+}
+
+
+const GapCounter* getGapCounter(void)
+{
+	return &counter;
+}
+
+
+void writeGapSummary(FILE* summaryFile)
+{
+	fprintf(summaryFile, "\n[missed]\r\n");
+	fprintf(summaryFile, "trigger_period = %.3f\r\n", counter.period*1e6);
+	fprintf(summaryFile, "period_source = %s\r\n", counter.is_calibrated ? "calibrated" : "estimated");
+	fprintf(summaryFile, "captured_ramps = %u\r\n", counter.n_captured);
+	fprintf(summaryFile, "missed_ramps = %u\r\n", counter.n_missed);
+	fprintf(summaryFile, "repeated_edges = %u\r\n", counter.n_repeats);
+	fprintf(summaryFile, "gaps = %u\r\n", counter.n_gaps);
+	fprintf(summaryFile, "longest_gap = %u\r\n", counter.max_gap);
+}
@@ -0,0 +1,36 @@
+#ifndef GAPS_H
+#define GAPS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define GAP_PERIOD_WINDOW		64			//ramps in which a short interval restarts an estimated period
+#define GAP_PLACEHOLDER_MAX		4096		//largest gap that is filled with placeholder ramps
+
+typedef struct
+{
+	double period;							//trigger period [s], 0 until two ramps were seen
+	double t_first;							//trigger time of the first captured ramp [s, CLOCK_MONOTONIC_RAW]
+	int is_calibrated;						//period seeded by the caller
+	uint32_t n_fit;							//ramps in the index/time fit
+	double mean_ramp;						//running means and co-moments of index and time since t_first
+	double mean_t;
+	double c_ramp;
+	double c_t;
+	double t_last;							//trigger time of the last captured ramp [s]
+	uint32_t ramp;							//along-track index of the last captured ramp
+	uint32_t n_captured;					//ramps captured
+	uint32_t n_repeats;						//edges that fell on the index already taken
+	uint32_t n_missed;						//ramps that went by while the capture loop was busy
+	uint32_t n_gaps;						//runs of missed ramps
+	uint32_t max_gap;						//longest run of missed ramps
+} GapCounter;
+
+void     initGapCounter(double period);
+uint32_t countGap(double t, uint32_t* ramp);
+const GapCounter* getGapCounter(void);
+void     writeGapSummary(FILE* summaryFile);
+
+#endif
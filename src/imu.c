@@ -5,6 +5,23 @@ uint8_t zero_buffer[4] = {0, 0, 0, 0};
 packet global_packet;
 heartbeat beat;
 
+//bytes carried over between uart reads while reassembling broadcast packets
+static uint8_t stream_buffer[STREAM_BUFFER_SIZE];
+static int stream_length = 0;
+static ImuSample imu_sample;
+
+//stream totals of the current collection
+static uint64_t stream_bytes = 0;
+static uint64_t stream_packets = 0;
+static uint64_t stream_discarded = 0;
+static uint64_t stream_attitudes = 0;
+
+static int extractPacket(uint8_t* rx_data, int rx_length, packet* rx_packet, int* consumed);
+static void appendStream(uint8_t* rx_data, int rx_length);
+static void consumeStream(int offset);
+static int findPacket(int address, uint8_t* rx_data, int rx_length);
+static void dispatchPacket(packet* rx_packet, double t);
+
 extern uint8_t* uart_buffer;
 
 // Parse the serial data obtained through the UART interface and fit to a general packet structure
@@ -32,7 +49,7 @@ uint8_t parseUART(int address, uint8_t* rx_data, uint8_t rx_length)
 			// loop executed to completion and never found a packet header.
 			if (packet_index == (rx_length - 2))
 			{
-				printf("Didn't find SNP\n");
+				logEvent(LOG_WARN, "Didn't find SNP\n");
 				return 0;
 			}
 			
@@ -149,6 +166,7 @@ void initIMU(Experiment *experiment)
 	//uint8_t proc_rates[4] = {0, 250, 0, 0};
 	//uint8_t temp_rate[4] = {250, 0, 0, 0};
 	uint8_t health[4] = {0, 6, 0, 0};
+	uint8_t pose_rates[4] = {POSE_RATE, 0, POSE_RATE, POSE_RATE};
 	//uint8_t position[4] = {0, 0, 255, 0};	
 	
 	writeRegister(CREG_COM_SETTINGS, 4, com_settings);		// baud rates, auto transmission		
@@ -156,7 +174,7 @@ void initIMU(Experiment *experiment)
 	writeRegister(CREG_COM_RATES2, 4, zero_buffer);			// temp rate and all raw data rate		
 	writeRegister(CREG_COM_RATES3, 4, zero_buffer);			// proc accel, gyro, mag rate		
 	//writeRegister(CREG_COM_RATES4, 4, proc_rates);			// all proc data rate	
-	writeRegister(CREG_COM_RATES5, 4, zero_buffer);			// quart, euler, position, velocity rate
+	writeRegister(CREG_COM_RATES5, 4, pose_rates);			// quart, euler, position, velocity rate
 	writeRegister(CREG_COM_RATES6, 4, health);				// heartbeat rate
 	writeRegister(CREG_COM_RATES7, 4, zero_buffer);			// CHR NMEA-style packets*/
 	
@@ -186,11 +204,193 @@ void initIMU(Experiment *experiment)
 }
 
 
+//reassemble broadcast packets from consecutive uart reads and decode them
+//returns the number of valid packets found
+int processUART(uint8_t* rx_data, int rx_length, double t)
+{
+	packet rx_packet;
+	int n_packets = 0;
+	int consumed = 0;
+	int offset = 0;
+	
+	if (rx_length <= 0)
+		return 0;
+	
+	appendStream(rx_data, rx_length);
+	
+	while (extractPacket(&stream_buffer[offset], stream_length - offset, &rx_packet, &consumed))
+	{
+		offset += consumed;
+		stream_discarded += consumed - (rx_packet.n_data_bytes + 7);
+		
+		if (rx_packet.n_data_bytes > 0)
+		{
+			//bytes after this packet arrived later, back its stamp off by their transfer time
+			dispatchPacket(&rx_packet, t - (stream_length - offset)*UART_BYTE_TIME);
+			n_packets++;
+		}
+	}
+	
+	offset += consumed;
+	stream_discarded += consumed;
+	stream_packets += n_packets;
+	
+	//keep any partial packet for the next read
+	consumeStream(offset);
+	
+	return n_packets;
+}
+
+
+static void appendStream(uint8_t* rx_data, int rx_length)
+{
+	stream_bytes += rx_length;
+	
+	//drop stale bytes rather than overflow
+	if (stream_length + rx_length > STREAM_BUFFER_SIZE)
+	{
+		stream_discarded += stream_length;
+		stream_length = 0;
+	}
+	
+	memcpy(&stream_buffer[stream_length], rx_data, rx_length);
+	stream_length += rx_length;
+}
+
+
+static void consumeStream(int offset)
+{
+	memmove(stream_buffer, &stream_buffer[offset], stream_length - offset);
+	stream_length -= offset;
+}
+
+
+//reassemble replies from consecutive uart reads, returns 1 once a packet from address is in global_packet
+static int findPacket(int address, uint8_t* rx_data, int rx_length)
+{
+	int consumed = 0;
+	int offset = 0;
+	
+	if (rx_length > 0)
+		appendStream(rx_data, rx_length);
+	
+	while (extractPacket(&stream_buffer[offset], stream_length - offset, &global_packet, &consumed))
+	{
+		offset += consumed;
+		
+		if (global_packet.address == address)
+		{
+			consumeStream(offset);
+			return 1;
+		}
+	}
+	
+	consumeStream(offset + consumed);
+	
+	return 0;
+}
+
+
+//returns 1 if a complete packet was found, consumed is set to the number of bytes that can be discarded
+static int extractPacket(uint8_t* rx_data, int rx_length, packet* rx_packet, int* consumed)
+{
+	int index = 0;
+	
+	while (index + 7 <= rx_length)
+	{
+		if (rx_data[index] != 's' || rx_data[index + 1] != 'n' || rx_data[index + 2] != 'p')
+		{
+			index++;
+			continue;
+		}
+		
+		uint8_t PT = rx_data[index + 3];
+		int data_length = 0;
+		
+		if (PT & PT_HAS_DATA)
+			data_length = (PT & PT_IS_BATCH) ? 4*((PT >> 2) & 0x0F) : 4;
+		
+		//wait for the rest of the packet
+		if (rx_length - index < data_length + 7)
+			break;
+		
+		uint16_t computed_checksum = 's' + 'n' + 'p' + PT + rx_data[index + 4];
+		
+		for (int k = 0; k < data_length; k++)
+			computed_checksum += rx_data[index + 5 + k];
+		
+		uint16_t received_checksum = (rx_data[index + 5 + data_length] << 8) | rx_data[index + 6 + data_length];
+		
+		if (received_checksum != computed_checksum)
+		{
+			index++;
+			continue;
+		}
+		
+		rx_packet->packet_type = PT;
+		rx_packet->address = rx_data[index + 4];
+		rx_packet->n_data_bytes = data_length;
+		rx_packet->checksum = computed_checksum;
+		memcpy(rx_packet->data, &rx_data[index + 5], data_length);
+		
+		*consumed = index + data_length + 7;
+		return 1;
+	}
+	
+	*consumed = index;
+	return 0;
+}
+
+
+//update the current imu sample, a new sample is pushed to the pose window on every attitude update
+static void dispatchPacket(packet* rx_packet, double t)
+{
+	float values[PACKET_DATA_SIZE/4];
+	
+	switch (rx_packet->address)
+	{
+		case DREG_QUAT_AB:
+			if (rx_packet->n_data_bytes < 8)
+				break;
+			
+			for (int i = 0; i < 4; i++)
+			{
+				int16_t component = (int16_t)((rx_packet->data[2*i] << 8) | rx_packet->data[2*i + 1]);
+				imu_sample.quat[i] = component/QUAT_SCALE;
+			}
+			
+			imu_sample.t = t;
+			pushImuSample(&imu_sample);
+			stream_attitudes++;
+			break;
+			
+		case DREG_POSITION_N:
+			if (svPacket(rx_packet, values) >= 3)
+				memcpy(imu_sample.pos, values, 3*sizeof(float));
+			break;
+			
+		case DREG_VELOCITY_N:
+			if (svPacket(rx_packet, values) >= 3)
+				memcpy(imu_sample.vel, values, 3*sizeof(float));
+			break;
+	}
+	
+	//gps time arrives alone or at the end of a gps batch
+	int n_values = rx_packet->n_data_bytes/4;
+	
+	if ((rx_packet->address <= DREG_GPS_TIME) && (rx_packet->address + n_values > DREG_GPS_TIME))
+	{
+		svPacket(rx_packet, values);
+		updateTimebase(values[DREG_GPS_TIME - rx_packet->address], t);
+	}
+}
+
+
 int txPacket(packet* tx_packet)
 {  
 	int msg_len = tx_packet->n_data_bytes + 7;
 
-	char tx_buffer[msg_len + 1];
+	uint8_t tx_buffer[msg_len + 1];
 	//Add header to buffer
 	tx_buffer[0] = 's';
 	tx_buffer[1] = 'n';
@@ -224,12 +424,12 @@ int txPacket(packet* tx_packet)
 	return 1;
 }
 
-//searches for the first valid paket within 'size' samples of the UART buffer
+//searches the next 'attempts' uart reads for a valid packet from address, packets may span reads
 int rxPacket(int address, int attempts)
 {
 	for (int i = 0; i < attempts; i++)
 	{
-		if (parseUART(address, uart_buffer, getUART()) == 1)
+		if (findPacket(address, uart_buffer, getUART()) == 1)
 		{
 			//found valid packet matching address -> global packet
 			return 1; 
@@ -241,18 +441,19 @@ int rxPacket(int address, int attempts)
 }
 
 
-//saves the data within the provided packet
-int svPacket(packet* sv_packet)
+//decodes the float registers held within the provided packet, returns the number of values
+int svPacket(packet* sv_packet, float* values)
 {
-	/*if ((sv_packet.address == DREG_ALL_PROC) && (sv_packet.packet_type &= PT_IS_BATCH))
-	{		
-		for (int i = 0; i < 12; i++)
-		{
-			float data = bit32ToFloat(bit8ArrayToBit32(&global_packet.data[4*i]));
-			fwrite(&data, sizeof(float), 1, imuFile);
-		}					
-	}*/
-	return 1;
+	if (!(sv_packet->packet_type & PT_HAS_DATA))
+	{
+		return 0;
+	}
+	
+	int n_values = sv_packet->n_data_bytes/4;
+	
+	bit8ArrayToFloatBatch(sv_packet->data, values, n_values);
+	
+	return n_values;
 }
 
 
@@ -330,7 +531,7 @@ int writeRegister(uint8_t address, uint8_t n_data_bytes, uint8_t *data)
 			return 0;
 		}
 	}	
-	while(rxPacket(address, 1) != 1);
+	while(rxPacket(address, RX_ATTEMPTS) != 1);
 	
 	return 1;
 }
@@ -505,9 +706,20 @@ void showHeartbeat(void)
 }
 
 
+void resetImuStats(void)
+{
+	stream_bytes = 0;
+	stream_packets = 0;
+	stream_discarded = 0;
+	stream_attitudes = 0;
+}
 
 
-
-
-
-
+void writeImuSummary(FILE* summaryFile)
+{
+	fprintf(summaryFile, "\n[imu]\r\n");
+	fprintf(summaryFile, "uart_bytes = %llu\r\n", (unsigned long long)stream_bytes);
+	fprintf(summaryFile, "packets = %llu\r\n", (unsigned long long)stream_packets);
+	fprintf(summaryFile, "attitude_updates = %llu\r\n", (unsigned long long)stream_attitudes);
+	fprintf(summaryFile, "discarded_bytes = %llu\r\n", (unsigned long long)stream_discarded);
+}
@@ -11,8 +11,11 @@
 #include "colour.h"
 #include "binary.h"
 #include "uart.h"
+#include "logger.h"
+#include "pose.h"
+#include "timebase.h"
 
-#define PACKET_DATA_SIZE 		30
+#define PACKET_DATA_SIZE 		60
 
 #define CREG_COM_SETTINGS 		0x00
 #define CREG_COM_RATES1 		0x01
@@ -43,6 +46,10 @@
 #define DREG_MAG_PROC_Z 		0x6B
 #define DREG_MAG_PROC_TIME 		0x6C
 
+#define DREG_QUAT_AB			0x6D
+#define DREG_QUAT_CD			0x6E
+#define DREG_QUAT_TIME			0x6F
+
 #define DREG_POSITION 			0x75
 
 #define DREG_POSITION_N 		0x75
@@ -50,6 +57,11 @@
 #define DREG_POSITION_UP 		0x77
 #define DREG_POSITION_TIME 		0x78
 
+#define DREG_VELOCITY_N 		0x79
+#define DREG_VELOCITY_E 		0x7A
+#define DREG_VELOCITY_UP 		0x7B
+#define DREG_VELOCITY_TIME 		0x7C
+
 #define GET_FW_REVISION			0xAA
 #define FLASH_COMMIT			0xAB
 #define RESET_TO_FACTORY		0xAC
@@ -74,6 +86,11 @@
 #define PT_CF	 				0b00000001
 #define PT_READ	 				0b00000000
 
+#define QUAT_SCALE				29789.09	//quaternion register scale factor
+#define POSE_RATE				50			//quaternion, position and velocity broadcast rate [Hz]
+#define STREAM_BUFFER_SIZE		(2*UART_BUFFER_SIZE)
+#define RX_ATTEMPTS				50			//uart reads searched for a reply before the request is sent again
+
 typedef struct 
 {
   uint8_t address;
@@ -101,7 +118,7 @@ void initIMU(Experiment *experiment);
 
 int rxPacket(int address, int attempts);
 int txPacket(packet* tx_packet);
-int svPacket(packet* sv_packet);
+int svPacket(packet* sv_packet, float* values);
 
 void writeCommand(int command);
 void readRegister(uint8_t address);
@@ -111,6 +128,9 @@ void getHeartbeat(void);
 void showHeartbeat(void);
 
 uint8_t parseUART(int address, uint8_t* rx_data, uint8_t rx_length);
+int processUART(uint8_t* rx_data, int rx_length, double t);
+void resetImuStats(void);
+void writeImuSummary(FILE* summaryFile);
 
 
 #endif
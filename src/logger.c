@@ -0,0 +1,389 @@
+#include "logger.h"
+#include "controller.h"
+
+//deferred logging for threads that must not block on the terminal.
+//logEvent stores the format pointer and the raw arguments in a ring owned by
+//the calling thread and returns, the logger thread formats the events to the
+//console and the log file of the collection. a full ring drops the event and
+//counts it, the caller never waits.
+
+static LogRing rings[LOG_MAX_THREADS];
+static __thread LogRing* thread_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_t logger_thread;
+static int is_logger_active = 0;
+
+//the log file is swapped under log_lock, which the hot path never takes
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* log_file = NULL;
+static double t_log_open = 0;
+static uint64_t n_logged = 0;
+static uint64_t n_dropped_reported = 0;
+
+static uint32_t n_unregistered = 0;		//events from threads that found no free ring
+
+static void* runLogger(void* arg);
+
+
+//hand the ring back when its thread exits, unread events are still formatted
+static void releaseRing(void* ring)
+{
+	__atomic_store_n(&((LogRing*)ring)->is_used, 0, __ATOMIC_RELEASE);
+}
+
+
+static LogRing* getThreadRing(void)
+{
+	if (thread_ring)
+		return thread_ring;
+	
+	for (int i = 0; i < LOG_MAX_THREADS; i++)
+	{
+		uint32_t is_used = 0;
+		
+		if (__atomic_compare_exchange_n(&rings[i].is_used, &is_used, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			thread_ring = &rings[i];
+			pthread_setspecific(ring_key, thread_ring);
+			return thread_ring;
+		}
+	}
+	
+	return NULL;
+}
+
+
+void initLogger(int cpu)
+{
+	if (is_logger_active)
+		return;
+	
+	pthread_key_create(&ring_key, releaseRing);
+	is_logger_active = 1;
+	
+	if (pthread_create(&logger_thread, NULL, runLogger, NULL))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Error launching logger thread.\n");
+		is_logger_active = 0;
+		return;
+	}
+	
+	pinThread(logger_thread, cpu);
+	atexit(dnitLogger);
+}
+
+
+void dnitLogger(void)
+{
+	if (!is_logger_active)
+		return;
+	
+	__atomic_store_n(&is_logger_active, 0, __ATOMIC_RELEASE);
+	pthread_join(logger_thread, NULL);
+	closeLogFile();
+}
+
+
+//only the argument types implied by the format are read, like printf
+void logEvent(int level, const char* format, ...)
+{
+	LogRing* ring = getThreadRing();
+	
+	if (!ring)
+	{
+		__atomic_add_fetch(&n_unregistered, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	
+	uint32_t head = ring->head;
+	
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE)
+	{
+		__atomic_add_fetch(&ring->n_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	
+	LogEvent* event = &ring->events[head & (LOG_RING_SIZE - 1)];
+	const char* p = format;
+	int n_args = 0;
+	va_list args;
+	
+	event->t = monotonicTime();
+	event->format = format;
+	event->level = level;
+	
+	va_start(args, format);
+	
+	while (n_args < LOG_MAX_ARGS && (p = strchr(p, '%')))
+	{
+		int n_long = 0;
+		
+		p++;
+		
+		if (*p == '%')
+		{
+			p++;
+			continue;
+		}
+		
+		//flags, width and precision
+		while (*p && strchr("-+ #0123456789.", *p))
+			p++;
+		
+		while (*p == 'l' || *p == 'h' || *p == 'z')
+			n_long += (*p++ != 'h');
+		
+		LogArg* arg = &event->args[n_args++];
+		
+		switch (*p)
+		{
+			case 'd': case 'i': case 'c':
+				arg->i = (n_long > 1) ? va_arg(args, long long) : (n_long ? va_arg(args, long) : va_arg(args, int));
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				arg->u = (n_long > 1) ? va_arg(args, unsigned long long) : (n_long ? va_arg(args, unsigned long) : va_arg(args, unsigned int));
+				break;
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+				arg->d = va_arg(args, double);
+				break;
+			case 's':
+				arg->s = va_arg(args, const char*);
+				break;
+			default:
+				n_args--;
+		}
+	}
+	
+	va_end(args);
+	
+	event->n_args = n_args;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+//expand the stored arguments one conversion at a time
+static void formatEvent(const LogEvent* event, char* line, int size)
+{
+	const char* p = event->format;
+	int length = 0;
+	uint32_t n_args = 0;
+	
+	while (*p && length < size - 1)
+	{
+		if (*p != '%' || p[1] == '%' || n_args >= event->n_args)
+		{
+			line[length++] = *p;
+			p += (*p == '%' && p[1] == '%') ? 2 : 1;
+			continue;
+		}
+		
+		//copy the conversion without its length modifier
+		char spec[32];
+		int n_spec = 0;
+		
+		spec[n_spec++] = *p++;
+		
+		while (*p && strchr("-+ #0123456789.", *p) && n_spec < 24)
+			spec[n_spec++] = *p++;
+		
+		while (*p == 'l' || *p == 'h' || *p == 'z')
+			p++;
+		
+		char conversion = *p;
+		
+		if (conversion)
+			p++;
+		
+		const LogArg* arg = &event->args[n_args++];
+		int n;
+		
+		switch (conversion)
+		{
+			case 'd': case 'i':
+				spec[n_spec++] = 'l'; spec[n_spec++] = 'l'; spec[n_spec++] = conversion; spec[n_spec] = '\0';
+				n = snprintf(line + length, size - length, spec, (long long)arg->i);
+				break;
+			case 'u': case 'x': case 'X': case 'o':
+				spec[n_spec++] = 'l'; spec[n_spec++] = 'l'; spec[n_spec++] = conversion; spec[n_spec] = '\0';
+				n = snprintf(line + length, size - length, spec, (unsigned long long)arg->u);
+				break;
+			case 'c':
+				spec[n_spec++] = conversion; spec[n_spec] = '\0';
+				n = snprintf(line + length, size - length, spec, (int)arg->i);
+				break;
+			case 's':
+				spec[n_spec++] = conversion; spec[n_spec] = '\0';
+				n = snprintf(line + length, size - length, spec, arg->s ? arg->s : "(null)");
+				break;
+			default:
+				spec[n_spec++] = conversion; spec[n_spec] = '\0';
+				n = snprintf(line + length, size - length, spec, arg->d);
+		}
+		
+		length += (n > 0) ? n : 0;
+		
+		if (length > size - 1)
+			length = size - 1;
+	}
+	
+	line[length] = '\0';
+}
+
+
+static void printEvent(const LogEvent* event)
+{
+	char line[LOG_LINE_SIZE];
+	
+	formatEvent(event, line, sizeof(line));
+	
+	switch (event->level)
+	{
+		case LOG_WARN:
+			cprint("[!!] ", BRIGHT, RED);
+			break;
+		case LOG_INFO:
+			cprint("[OK] ", BRIGHT, GREEN);
+			break;
+		default:
+			cprint("[**] ", BRIGHT, CYAN);
+	}
+	
+	fputs(line, stdout);
+	
+	if (log_file)
+		fprintf(log_file, "%12.6f %s", event->t - t_log_open, line);
+	
+	n_logged++;
+}
+
+
+//format every pending event, returns the number handled
+static int drainRings(void)
+{
+	int n = 0;
+	
+	pthread_mutex_lock(&log_lock);
+	
+	for (int i = 0; i < LOG_MAX_THREADS; i++)
+	{
+		LogRing* ring = &rings[i];
+		uint32_t tail = ring->tail;
+		uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		
+		for (; tail != head; tail++, n++)
+			printEvent(&ring->events[tail & (LOG_RING_SIZE - 1)]);
+		
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	
+	pthread_mutex_unlock(&log_lock);
+	
+	if (n)
+		fflush(stdout);
+	
+	return n;
+}
+
+
+static uint64_t countDropped(void)
+{
+	uint64_t n = __atomic_load_n(&n_unregistered, __ATOMIC_RELAXED);
+	
+	for (int i = 0; i < LOG_MAX_THREADS; i++)
+		n += __atomic_load_n(&rings[i].n_dropped, __ATOMIC_RELAXED);
+	
+	return n;
+}
+
+
+static void* runLogger(void* arg)
+{
+	while (__atomic_load_n(&is_logger_active, __ATOMIC_ACQUIRE))
+	{
+		if (!drainRings())
+			usleep(1e3);
+	}
+	
+	drainRings();
+	
+	return NULL;
+}
+
+
+//wait until the events logged so far have been printed, e.g. before prompting
+void flushLogger(void)
+{
+	for (int i = 0; i < LOG_MAX_THREADS; i++)
+	{
+		uint32_t head = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+		
+		while (is_logger_active && (int32_t)(head - __atomic_load_n(&rings[i].tail, __ATOMIC_ACQUIRE)) > 0)
+			usleep(1e3);
+	}
+	
+	//no logger thread, format in the caller
+	if (!is_logger_active)
+		drainRings();
+	
+	pthread_mutex_lock(&log_lock);
+	
+	if (log_file)
+		fflush(log_file);
+	
+	pthread_mutex_unlock(&log_lock);
+}
+
+
+//log events to filename as well as the console until closeLogFile
+int openLogFile(const char* filename)
+{
+	flushLogger();
+	
+	FILE* file = fopen(filename, "w");
+	
+	if (!file)
+		return 0;
+	
+	pthread_mutex_lock(&log_lock);
+	t_log_open = monotonicTime();
+	n_logged = 0;
+	n_dropped_reported = countDropped();
+	log_file = file;
+	pthread_mutex_unlock(&log_lock);
+	
+	return 1;
+}
+
+
+void closeLogFile(void)
+{
+	flushLogger();
+	
+	pthread_mutex_lock(&log_lock);
+	
+	if (log_file)
+		fclose(log_file);
+	
+	log_file = NULL;
+	pthread_mutex_unlock(&log_lock);
+}
+
+
+//events logged and dropped since openLogFile
+void writeLoggerSummary(FILE* summaryFile)
+{
+	flushLogger();
+	
+	uint64_t n_dropped = countDropped() - n_dropped_reported;
+	
+	if (n_dropped)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Log entries dropped: %llu\n", (unsigned long long)n_dropped);
+	}
+	
+	fprintf(summaryFile, "\n[log]\r\n");
+	fprintf(summaryFile, "log_entries = %llu\r\n", (unsigned long long)n_logged);
+	fprintf(summaryFile, "log_dropped = %llu\r\n", (unsigned long long)n_dropped);
+}
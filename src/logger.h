@@ -0,0 +1,56 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "colour.h"
+
+#define LOG_RING_SIZE			256			//events buffered per thread (power of 2)
+#define LOG_MAX_THREADS			8			//threads logging at the same time
+#define LOG_MAX_ARGS			6
+#define LOG_LINE_SIZE			256
+
+#define LOG_DEBUG				0			//[**] cyan
+#define LOG_INFO				1			//[OK] green
+#define LOG_WARN				2			//[!!] red
+
+typedef union
+{
+	int64_t i;
+	uint64_t u;
+	double d;
+	const char* s;
+} LogArg;
+
+//the format and %s arguments are stored as pointers and must be string literals
+typedef struct
+{
+	double t;								//[s, CLOCK_MONOTONIC_RAW]
+	const char* format;
+	uint32_t level;
+	uint32_t n_args;
+	LogArg args[LOG_MAX_ARGS];
+} LogEvent;
+
+typedef struct
+{
+	LogEvent events[LOG_RING_SIZE];
+	uint32_t head;							//written by the owning thread
+	uint32_t tail;							//written by the logger thread
+	uint32_t n_dropped;						//events lost because the ring was full
+	uint32_t is_used;						//ring owned by a live thread
+} LogRing;
+
+void initLogger(int cpu);
+void dnitLogger(void);
+void logEvent(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void flushLogger(void);
+int  openLogFile(const char* filename);
+void closeLogFile(void);
+void writeLoggerSummary(FILE* summaryFile);
+
+#endif
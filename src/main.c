@@ -9,11 +9,36 @@
 #include "rp.h"
 #include "colour.h"
 #include "imu.h"
+#include "pose.h"
+#include "timebase.h"
+#include "writer.h"
+#include "gaps.h"
+#include "calibrate.h"
+#include "plan.h"
+#include "bench.h"
+#include "daemon.h"
+#include "schedule.h"
+#include "config.h"
+#include "logger.h"
+#include "trace.h"
+#include "counters.h"
+#include "preflight.h"
+#include "sim.h"
 
 void splash(void);
 void help(void);
 void parse_uart(void);
 void parse_options(int argc, char *argv[]);
+void loadSynths(void);
+void programSynths(void);
+void initHardware(void);
+void initIMUOnce(void);
+void dnitIMU(void);
+int  runCapture(int is_interactive);
+void runDaemon(void);
+int  runSchedule(const char* filename);
+void markStartup(const char* phase);
+void reportStartup(FILE* summaryFile);
 
 extern heartbeat beat;
 extern uint8_t* uart_buffer;
@@ -27,9 +52,44 @@ Experiment experiment;
 Synthesizer synthOne;
 Synthesizer synthTwo;
 
+//parameter files compared by the capacity planner
+char* lo_files[PLAN_MAX_FILES];
+char* rf_files[PLAN_MAX_FILES];
+int n_lo_files = 0;
+int n_rf_files = 0;
+double plan_card_size = -1;
+int is_benchmark = 0;
+
+//daemon state, a collection runs on its own thread and is stopped through is_capture_stopped
+int is_daemon = 0;
+int is_imu_ready = 0;
+int is_capture_running = 0;
+int is_capture_stopped = 0;
+
+//burst schedule recorded back to back
+char* schedule_filename = NULL;
+
+//headless runs take the ramp count and comment from the command line
+int is_headless = 0;
+char* headless_comment = "";
+
+//time from launch to the end of each startup phase, reported once for the first collection
+#define STARTUP_MAX_PHASES 10
+
+typedef struct
+{
+	const char* name;
+	double t;
+} StartupPhase;
+
+double t_launch = 0;
+StartupPhase startup[STARTUP_MAX_PHASES];
+int n_startup = 0;
+int is_startup_reported = 0;
+
 int main(int argc, char *argv[])
 {
-	pthread_t imu_thread;
+	t_launch = monotonicTime();
 	
 	//initialise default values
 	synthOne.number = 1;
@@ -37,60 +97,220 @@ int main(int argc, char *argv[])
 	experiment.storageDir = "/media/storage";
 	experiment.is_debug_mode = 0;
 	experiment.adc_channel = 0;
-
+	experiment.sample_format = SAMPLE_FORMAT_INT16;
+	experiment.segment_size = 0;
+	experiment.segment_ramps = 0;
+	experiment.is_placeholder = 0;
+	experiment.is_calibration = 1;
+	experiment.ns_requested = 0;
+	experiment.preview_every = 0;
+	experiment.is_trace = 0;
+	experiment.is_counters = 0;
+	experiment.is_preflight_forced = 0;
+	experiment.uart_device = UART_DEVICE;
+	
 	//parse command line options
 	parse_options(argc, argv);
+	markStartup("options");
+	
+	//messages from the capture threads are formatted on the auxiliary core
+	initLogger(AUX_CPU);
+	
+	//check the ramp profiles against the capture budget without touching the hardware
+	if (plan_card_size >= 0)
+	{
+		experiment.decFactor = 8;
+		return planCapacity(&experiment, lo_files, n_lo_files, rf_files, n_rf_files, plan_card_size) ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	
+	//sweep the internal trigger rate through the capture and write pipeline
+	if (is_benchmark)
+	{
+		initRP();
+		runBenchmark(&experiment, &synthOne, &synthTwo);
+		releaseRP();
+		return EXIT_SUCCESS;
+	}
 	
 	//display splash screen
 	splash();
+	
+	loadSynths();
+	markStartup("synth_files");
+	
+	initHardware();
+	
+	//keep the hardware initialised and take collections from rpcctl
+	if (is_daemon)
+	{
+		runDaemon();
+		dnitIMU();
+		releaseRP();
+		return EXIT_SUCCESS;
+	}
+	
+	//record every burst of the schedule without restarting
+	if (schedule_filename)
+	{
+		int is_done = runSchedule(schedule_filename);
+		dnitIMU();
+		releaseRP();
+		return is_done ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	
+	//get user input for final experiment settings
+	if (is_headless)
+		configureExperiment(&experiment, &synthOne, &synthTwo, headless_comment);
+	else
+		configureVerbose(&experiment, &synthOne, &synthTwo);
+	
+	int is_written = runCapture(!is_headless);
+	
+	//compare the run with the expectations of the fault schedule (simulator builds)
+	is_written &= checkFaults(&experiment);
+	
+	dnitIMU();
+	releaseRP();
+	
+	return is_written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-	//get parameters for ini files
-	getParameters(&synthOne);
-	getParameters(&synthTwo);
 
-	//calculate additional ramp parameters
-	calculateRampParameters(&synthOne, &experiment);
-	calculateRampParameters(&synthTwo, &experiment);
+//prepare the register arrays of both synths, compiled from the ramp files only when they changed
+void loadSynths(void)
+{
+	loadConfiguration(&experiment, &synthOne, &synthTwo);
+}
 
-	//convert necessary values to binary
-	generateBinValues(&synthOne);
-	generateBinValues(&synthTwo);
 
-	//import register values from template file
-	readTemplateFile("template/register_template.txt", &synthOne);
-	readTemplateFile("template/register_template.txt", &synthTwo);
+//reset the synths and send them the register arrays
+void programSynths(void)
+{
+	//software reset all synth register values
+	setRegister(&synthOne, 2, 0b00000100);
+	setRegister(&synthTwo, 2, 0b00000100);
+	
+	//send register array values to synths
+	updateRegisters(&synthOne);
+	updateRegisters(&synthTwo);
+}
 
-	//insert calculated ramp parameters into register array
-	insertRampParameters(&synthOne);
-	insertRampParameters(&synthTwo);
 
+//bring up the red pitaya, reference clock, synths and adc, then calibrate
+void initHardware(void)
+{
 	//initialise the red pitaya and configure pins
 	initRP();
 	initPins(&synthOne);
 	initPins(&synthTwo);
-
+	
 	//red pitaya provides 50 MHz reference signal for synth's
 	generateClock();
-
-	//software reset all synth register values
-	setRegister(&synthOne, 2, 0b00000100);
-	setRegister(&synthTwo, 2, 0b00000100);
-
-	//send register array values to synths
-	updateRegisters(&synthOne);
-	updateRegisters(&synthTwo);
+	markStartup("red_pitaya");
+	
+	programSynths();
+	markStartup("registers");
 	
 	//set experiment values
 	experiment.ns_ext_buffer = 1280;	
 	experiment.u_max_loop = 950; 	
+	experiment.decFactor = 8;
+	
+	rp_AcqSetDecimation(RP_DEC_8);	
+	rp_AcqSetAveraging(false);
+	
+	//set how many samples are recorded after trigger occurs.
+	//by default, ADC_BUFFER_SIZE/2 more samples are recorded.
+	//thus, using rp_AcqSetTriggerDelay(-ADC_BUFFER_SIZE/2) results 
+	//in no new samples being recorded
+	rp_AcqSetTriggerDelay(-ADC_BUFFER_SIZE/2);
+	
+	//fit the transfer cost and measure the trigger period to size the capture
+	if (experiment.is_calibration)
+	{
+		if (!calibrateTransfer(&experiment))
+		{
+			cprint("[!!] ", BRIGHT, RED);
+			printf("Transfer calibration failed.\n");
+		}
+		
+		calibrateTrigger(&synthOne, &synthTwo);
+		applyCalibration(&experiment, experiment.ns_requested);
+	}
+	else if (experiment.ns_requested)
+	{
+		experiment.ns_ext_buffer = experiment.ns_requested;
+	}
+	
+	markStartup("calibration");
+}
+
+
+//bring up the imu on the first collection, it stays configured for later ones
+void initIMUOnce(void)
+{
+	if (is_imu_ready)
+		return;
+	
+	initUART(experiment.uart_device, B115200);
+	initTimebase();
+	initIMU(&experiment);
+	is_imu_ready = 1;
+}
+
+
+void dnitIMU(void)
+{
+	if (!is_imu_ready)
+		return;
+	
+	dnitUART();
+	is_imu_ready = 0;
+}
+
+
+//record experiment.n_ramps ramps into the configured experiment folder.
+//the synths are started by the enter key when interactive, immediately otherwise.
+int runCapture(int is_interactive)
+{
+	pthread_t imu_thread;
+	
 	experiment.n_flags = 0;		
 	experiment.n_corrupt = 0;		
 	experiment.n_missed = 0;	
 	experiment.trigger_source = RP_TRIG_SRC_EXT_PE;	
-	experiment.decFactor = 8;
 	
-	//get user input for final experiment settings
-	configureVerbose(&experiment, &synthOne, &synthTwo);
+	//refuse to start when the card cannot hold or keep up with the collection
+	if (!runPreflight(&experiment, &synthOne) && !experiment.is_preflight_forced)
+	{
+		FILE* summaryFile = appendSummary(&experiment);
+		
+		if (summaryFile)
+		{
+			writePreflightSummary(summaryFile);
+			fclose(summaryFile);
+		}
+		
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Collection not started, use -F to start anyway.\n");
+		return 0;
+	}
+	
+	//a requested capture size that the calibration found too slow for the triggers
+	if (experiment.is_calibration && !getCalibration()->is_feasible && !experiment.is_preflight_forced)
+	{
+		FILE* summaryFile = appendSummary(&experiment);
+		
+		if (summaryFile)
+		{
+			writeCalibrationSummary(summaryFile);
+			fclose(summaryFile);
+		}
+		
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Collection not started, %i samples cannot keep up, use -F to start anyway.\n", experiment.ns_ext_buffer);
+		return 0;
+	}
 	
 	/*if (experiment.n_ramps > 0)
 	{
@@ -108,31 +328,27 @@ int main(int argc, char *argv[])
 	setRegister(&synthOne, 58, 0b00100001);
 	setRegister(&synthTwo, 58, 0b00100001);	
 	
-	FILE *extFile;
-
 	struct timeval start_time, transfer_time, loop_time;	
 	
+	//ramp trigger time used to interpolate the platform pose [s]
+	double trigger_time = 0;
+	
 	//time required to fill the adc buffer with fresh data [us]
-	int u_adc_buffer = 1.1*experiment.ns_ext_buffer*((float)experiment.decFactor/(float)ADC_RATE)*1e6;
-
+	int u_adc_buffer = ADC_REFILL_MARGIN*experiment.ns_ext_buffer*((float)experiment.decFactor/(float)ADC_RATE)*1e6;
+	
 	//time used by the rp_AcqGetLatestDataRaw function to transfer data from fpga to cpu [us]
 	double transfer_duration = 0;
 	
 	//total time used by the data capture loop used as indication for lost flags [us]
 	double loop_duration = 0;
 	
-	//buffer used to store adc samples 
-	int16_t* extBuffer = (int16_t*)malloc(experiment.ns_ext_buffer*sizeof(int16_t*));	
-	memset(extBuffer, 0, experiment.ns_ext_buffer);
+	//writer ring slot that the adc samples are transferred into
+	int16_t* extBuffer;
+	RampMeta* rampMeta;
 	
-	rp_AcqSetDecimation(RP_DEC_8);	
-	rp_AcqSetAveraging(false);
-	
-	//set how many samples are recorded after trigger occurs.
-	//by default, ADC_BUFFER_SIZE/2 more samples are recorded.
-	//thus, using rp_AcqSetTriggerDelay(-ADC_BUFFER_SIZE/2) results 
-	//in no new samples being recorded
-	rp_AcqSetTriggerDelay(-ADC_BUFFER_SIZE/2);
+	//along-track index of the current ramp and triggers missed before it
+	uint32_t ramp_index = 0;
+	uint32_t n_gap = 0;
 	
 	if (experiment.is_debug_mode)
 	{
@@ -152,17 +368,43 @@ int main(int argc, char *argv[])
 		printf("Capture delay: %i\n", u_adc_buffer);
 	}		
 	
-	if (!(extFile = fopen(experiment.ch1_filename, "wb"))) 
+	if (experiment.log_filename[0] && !openLogFile(experiment.log_filename))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open %s.\n", experiment.log_filename);
+	}
+	
+	//record the pipeline timeline, written to trace.json after the collection
+	if (experiment.is_trace && initTrace())
+		traceThread("capture");
+	
+	//count cycles, cache and tlb misses per phase
+	initCounters(experiment.is_counters);
+	openCounters();
+	
+	//ramps are written to the chunked container from the auxiliary core
+	if (!initWriter(&experiment, &synthOne, &synthTwo, AUX_CPU)) 
 	{
 		fprintf(stderr, "ext file open failed, %s\n", strerror(errno));
-		return EXIT_FAILURE;
+		closeLogFile();
+		setRegister(&synthOne, 58, 0b00100000);
+		setRegister(&synthTwo, 58, 0b00100000);
+		return 0;
 	}	
 	
+	markStartup("writer");
+	
 	//initialise IMU and configure update rates
 	if (experiment.is_imu) 
 	{
-		initUART(B115200);
-		initIMU(&experiment);
+		initIMUOnce();
+		
+		//interpolate imu samples onto ramp trigger times
+		if (initPose(experiment.pose_filename, experiment.samples_filename, AUX_CPU))
+		{
+			cprint("[OK] ", BRIGHT, GREEN);
+			printf("Pose sidecar active.\n");
+		}
 		
 		is_experiment_active = true;
 		
@@ -175,11 +417,18 @@ int main(int argc, char *argv[])
 		{
 			//start experiment
 			is_experiment_active = true;
+			pinThread(imu_thread, AUX_CPU);
 			cprint("[OK] ", BRIGHT, GREEN);
 			printf("IMU active.\n");
 		}
 	}
 	
+	//keep the capture loop on its own core
+	pinThread(pthread_self(), ACQ_CPU);
+	
+	//trigger period is taken from calibration, or learned from the captured ramps
+	initGapCounter(getCalibration()->trigger_period*1e-6);
+	
 	//start adc sampling
 	rp_AcqStart();	
 	
@@ -188,15 +437,21 @@ int main(int argc, char *argv[])
 	
 	//set the source of the adc trigger
 	rp_AcqSetTriggerSrc(experiment.trigger_source);		
-
+	
 	//trigger synth's to begin generating ramps at the same time
-	parallelTrigger(&synthOne, &synthTwo);	
+	if (is_interactive)
+		parallelTrigger(&synthOne, &synthTwo);	
+	else
+		pulseTrigger(&synthOne, &synthTwo);
 	
 	//allow imu thread activity
 	is_imu_allowed = true;
 	
+	//begin of the phase being traced or counted
+	PhaseProbe phase, ramp_phase;
+	
 	//loop until the specified number of ramps have been detected
-	while (experiment.n_flags < experiment.n_ramps) 								//(n_flags < (pow(2, 13) - 1 - 1)/4 - n_missed)
+	while ((experiment.n_flags < experiment.n_ramps) && !__atomic_load_n(&is_capture_stopped, __ATOMIC_RELAXED)) 	//(n_flags < (pow(2, 13) - 1 - 1)/4 - n_missed)
 	{
 		//get the latest state of the ADC trigger source
 		rp_AcqGetTriggerSrc(&experiment.trigger_source);
@@ -209,25 +464,56 @@ int main(int argc, char *argv[])
 			
 			//get start time
 			gettimeofday(&start_time, NULL);	
+			trigger_time = simTriggerTime(monotonicTime());
+			beginPhase(&ramp_phase);
 			
 			//flag has been detected
 			experiment.n_flags += 1;				
 			
-			//transfer data from ADC buffer to RAM
+			if (experiment.n_flags == 1)
+			{
+				experiment.t_start = trigger_time;
+				
+				if (!is_startup_reported && n_startup < STARTUP_MAX_PHASES)
+					startup[n_startup++] = (StartupPhase){"first_ramp", trigger_time};
+			}
+			
+			//count the triggers that went by while the loop was busy
+			beginPhase(&phase);
+			n_gap = countGap(trigger_time, &ramp_index);
+			experiment.n_missed += n_gap;
+			
+			//queue the ramp for pose interpolation on the auxiliary core
+			if (experiment.is_imu)
+				pushRamp(ramp_index, trigger_time);
+			
+			endPhase(TRACE_GAP, &phase, ramp_index);
+			
+			//transfer data from ADC buffer to the next writer slot
+			beginPhase(&phase);
+			extBuffer = getWriterSlot(&rampMeta);
 			rp_AcqGetLatestDataRaw(RP_CH_1, &experiment.ns_ext_buffer, extBuffer);		
+			endPhase(TRACE_TRANSFER, &phase, ramp_index);
 			
 			//restart adc sampling
+			beginPhase(&phase);
 			rp_AcqStart();
+			endPhase(TRACE_ACQ_START, &phase, ramp_index);
 			
 			//get transfer time
 			gettimeofday(&transfer_time, NULL);				
 			transfer_duration = elapsed_us(start_time, transfer_time);
 			
+			rampMeta->ramp = ramp_index;
+			rampMeta->flags = n_gap ? RAMP_GAP : RAMP_OK;
+			rampMeta->t = trigger_time;
+			
 			//check to see if there is enough time to fill the adc buffer with new data
 			if (experiment.u_max_loop - transfer_duration < u_adc_buffer) 
 			{				
 				experiment.n_corrupt += 1;		
-				printf("Data transfer took %.2f us\n", transfer_duration);
+				rampMeta->flags |= RAMP_CORRUPT;
+				logEvent(LOG_WARN, "Data transfer took %.2f us\n", transfer_duration);
 			}
 			else
 			{
@@ -235,11 +521,15 @@ int main(int argc, char *argv[])
 				//usleep(u_adc_buffer);		 - causes spurious lags!!! Use with caution.
 			}	
 			
-			//transfer buffer to SD
-			fwrite(extBuffer, sizeof(int16_t), experiment.ns_ext_buffer, extFile);
-		
+			//queue buffer for the writer thread
+			beginPhase(&phase);
+			commitWriterSlot();
+			endPhase(TRACE_COMMIT, &phase, ramp_index);
+			
 			//set state of ADC trigger back to external pin rising edge.
+			beginPhase(&phase);
 			rp_AcqSetTriggerSrc(RP_TRIG_SRC_EXT_PE);
+			endPhase(TRACE_TRIGGER_SOURCE, &phase, ramp_index);
 			
 			//get loop time
 			gettimeofday(&loop_time, NULL);				
@@ -247,26 +537,61 @@ int main(int argc, char *argv[])
 			
 			//enable imu thread activity
 			is_imu_allowed = true;		
-
+			
+			endPhase(TRACE_RAMP, &ramp_phase, ramp_index);
+			
 			//check to see if a flag could be lost
 			if (loop_duration > experiment.u_max_loop) 
 			{				
-				//experiment.n_missed += loop_duration/experiment.u_max_loop;	
-				printf("Loop took %.2f us\n", loop_duration);	
+				logEvent(LOG_WARN, "Loop took %.2f us\n", loop_duration);	
 			}	
 		}
 	}		
 	
 	is_experiment_active = false;
-
+	closeCounters();
+	
+	//flush outstanding chunks and write the ramp index
+	int is_written = dnitWriter();
 	
-	fclose(extFile);		
-
 	if (experiment.is_imu) 
 	{
 		//join all threads
 		pthread_join(imu_thread, NULL);		
-		dnitUART();
+		dnitPose();
+	}
+	
+	//print what the capture threads logged before the run report
+	flushLogger();
+	
+	if (experiment.is_trace)
+		writeTrace(experiment.trace_filename);
+	
+	//record the results of the run
+	FILE* summaryFile = appendSummary(&experiment);
+	
+	if (summaryFile)
+	{
+		writePreflightSummary(summaryFile);
+		writeWriterSummary(summaryFile);
+		writeGapSummary(summaryFile);
+		writeQualitySummary(summaryFile);
+		writeLoggerSummary(summaryFile);
+		writeCounterSummary(summaryFile);
+		
+		if (experiment.is_calibration)
+			writeCalibrationSummary(summaryFile);
+		
+		//stamp the run with gps referenced time
+		if (experiment.is_imu)
+		{
+			writeTimebaseSummary(summaryFile, experiment.t_start);
+			writeImuSummary(summaryFile);
+		}
+		
+		reportStartup(summaryFile);
+		
+		fclose(summaryFile);
 	}
 	
 	if (experiment.n_missed > 0)
@@ -292,34 +617,311 @@ int main(int argc, char *argv[])
 		cprint("[**] ", BRIGHT, CYAN);
 		printf("Storage location: %s/%s\n", experiment.storageDir, experiment.timeStamp);
 	}
-
+	
+	closeLogFile();
+	
 	//disable ramping now that specified number of ramps have been synthesized
 	setRegister(&synthOne, 58, 0b00100000);
 	setRegister(&synthTwo, 58, 0b00100000);
 	
-	if (experiment.is_debug_mode)
+	return is_written;
+}
+
+
+//note the end of a startup phase, ignored after the first collection
+void markStartup(const char* phase)
+{
+	if (is_startup_reported || n_startup >= STARTUP_MAX_PHASES)
+		return;
+	
+	startup[n_startup].name = phase;
+	startup[n_startup].t = monotonicTime();
+	n_startup++;
+}
+
+
+//print the time spent in each startup phase and write the [startup] summary section
+void reportStartup(FILE* summaryFile)
+{
+	if (is_startup_reported)
+		return;
+	
+	is_startup_reported = 1;
+	
+	double t_previous = t_launch;
+	
+	fprintf(summaryFile, "\r\n[startup]\r\n");
+	
+	for (int i = 0; i < n_startup; i++)
+	{
+		if (experiment.is_debug_mode)
+		{
+			cprint("[**] ", BRIGHT, CYAN);
+			printf("Startup %-12s %8.1f ms\n", startup[i].name, (startup[i].t - t_previous)*1e3);
+		}
+		
+		fprintf(summaryFile, "%s = %.6f\r\n", startup[i].name, startup[i].t - t_launch);
+		t_previous = startup[i].t;
+	}
+	
+	//the last phase is the first ramp unless the collection was stopped before one arrived
+	if (n_startup && !strcmp(startup[n_startup - 1].name, "first_ramp"))
 	{
+		double t_first = startup[n_startup - 1].t - t_launch;
+		
+		cprint("[OK] ", BRIGHT, GREEN);
+		printf("Time to first ramp: %.1f ms\n", t_first*1e3);
+		fprintf(summaryFile, "time_to_first_ramp = %.6f\r\n", t_first);
+	}
+}
+
+
+static int isRampFile(const char* filename)
+{
+	char path[DAEMON_LINE_SIZE];
+	
+	snprintf(path, sizeof(path), "ramps/%s", filename);
+	
+	return !access(path, R_OK);
+}
+
+
+static void* runCaptureThread(void* arg)
+{
+	runCapture(0);
+	__atomic_store_n(&is_capture_running, 0, __ATOMIC_RELEASE);
+	
+	return NULL;
+}
+
+
+//record the bursts of a schedule file back to back. ramp files are reloaded
+//while the adc is idle, and that setup time counts towards the gap.
+int runSchedule(const char* filename)
+{
+	static Schedule schedule;
+	int is_ok = 1;
+	double t_next = 0;
+	
+	if (!loadSchedule(filename, &schedule, synthOne.parameterFile, synthTwo.parameterFile))
+		return 0;
+	
+	for (int i = 0; i < schedule.n_bursts; i++)
+	{
+		Burst* burst = &schedule.bursts[i];
+		double t_setup = monotonicTime();
+		
+		if (strcmp(burst->lo, synthOne.parameterFile) || strcmp(burst->rf, synthTwo.parameterFile))
+		{
+			if (!isRampFile(burst->lo) || !isRampFile(burst->rf))
+			{
+				cprint("[!!] ", BRIGHT, RED);
+				printf("Burst %i: no such ramp file.\n", i);
+				return 0;
+			}
+			
+			synthOne.parameterFile = burst->lo;
+			synthTwo.parameterFile = burst->rf;
+			loadSynths();
+			programSynths();
+			
+			//a new ramp chain changes the trigger period
+			if (experiment.is_calibration)
+			{
+				calibrateTrigger(&synthOne, &synthTwo);
+				applyCalibration(&experiment, experiment.ns_requested);
+			}
+		}
+		
+		experiment.n_ramps = burst->n_ramps;
+		configureExperiment(&experiment, &synthOne, &synthTwo, burst->comment);
+		
+		double wait = t_next - monotonicTime();
+		
+		if (wait > 0)
+			usleep(wait*1e6);
+		
+		double setup_time = monotonicTime() - t_setup;
+		
 		cprint("[**] ", BRIGHT, CYAN);
-		printf("Enter password to transfer files:\n");
+		printf("Burst %i/%i: %i ramps, %s + %s\n", i + 1, schedule.n_bursts, burst->n_ramps, burst->lo, burst->rf);
+		
+		is_ok &= runCapture(0);
+		t_next = monotonicTime() + burst->gap;
+		
+		FILE* summaryFile = appendSummary(&experiment);
 		
-		//copy experiment folder from red pitaya to host computer
-		char syscmd[100];
-		sprintf(syscmd, "scp -r %s/%s darryn@10.42.0.1:/home/darryn/Dropbox/Datasets/Temp", experiment.storageDir, experiment.timeStamp);		
-		system(syscmd);
+		if (summaryFile)
+		{
+			fprintf(summaryFile, "\n[burst]\r\n");
+			fprintf(summaryFile, "schedule = %s\r\n", filename);
+			fprintf(summaryFile, "burst = %i\r\n", i);
+			fprintf(summaryFile, "n_bursts = %i\r\n", schedule.n_bursts);
+			fprintf(summaryFile, "gap = %.3f\r\n", burst->gap);
+			fprintf(summaryFile, "setup_time = %.3f\r\n", setup_time);
+			fclose(summaryFile);
+		}
 	}
 	
-	releaseRP();
+	return is_ok;
+}
+
 
-	return EXIT_SUCCESS;
+//serve rpcctl commands until quit, collections run on their own thread
+void runDaemon(void)
+{
+	char line[DAEMON_LINE_SIZE];
+	pthread_t capture_thread;
+	char* config_files[2] = {NULL, NULL};
+	int is_thread = 0;
+	int is_active = 1;
+	
+	if (!initDaemon(DAEMON_SOCKET))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open %s.\n", DAEMON_SOCKET);
+		return;
+	}
+	
+	//command handling and file setup stay off the acquisition core
+	pinThread(pthread_self(), AUX_CPU);
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Daemon listening on %s.\n", DAEMON_SOCKET);
+	
+	while (is_active)
+	{
+		int client = acceptCommand(line, sizeof(line));
+		
+		if (client < 0)
+			continue;
+		
+		char* save;
+		char* command = strtok_r(line, " ", &save);
+		int is_running = __atomic_load_n(&is_capture_running, __ATOMIC_ACQUIRE);
+		
+		//collect a finished capture thread before anything else
+		if (is_thread && !is_running)
+		{
+			pthread_join(capture_thread, NULL);
+			is_thread = 0;
+		}
+		
+		if (!command)
+		{
+			replyCommand(client, "ERR empty command");
+		}
+		else if (!strcmp(command, "start"))
+		{
+			char* ramps = strtok_r(NULL, " ", &save);
+			char* comment = strtok_r(NULL, "", &save);
+			
+			if (is_running)
+			{
+				replyCommand(client, "ERR collection running");
+			}
+			else if (!ramps || atoi(ramps) <= 0)
+			{
+				replyCommand(client, "ERR start <n_ramps> [comment]");
+			}
+			else
+			{
+				experiment.n_ramps = atoi(ramps);
+				configureExperiment(&experiment, &synthOne, &synthTwo, comment ? comment : "");
+				__atomic_store_n(&is_capture_running, 1, __ATOMIC_RELEASE);
+				
+				//cleared before the thread exists, so a stop that follows at once is not lost
+				__atomic_store_n(&is_capture_stopped, 0, __ATOMIC_RELAXED);
+				
+				if (pthread_create(&capture_thread, NULL, runCaptureThread, NULL))
+				{
+					__atomic_store_n(&is_capture_running, 0, __ATOMIC_RELEASE);
+					replyCommand(client, "ERR could not start capture thread");
+				}
+				else
+				{
+					is_thread = 1;
+					replyCommand(client, "OK %s/%s", experiment.storageDir, experiment.timeStamp);
+				}
+			}
+		}
+		else if (!strcmp(command, "stop") || !strcmp(command, "quit"))
+		{
+			if (is_thread)
+			{
+				__atomic_store_n(&is_capture_stopped, 1, __ATOMIC_RELAXED);
+				pthread_join(capture_thread, NULL);
+				is_thread = 0;
+			}
+			
+			is_active = strcmp(command, "quit");
+			replyCommand(client, "OK %i %i %i", experiment.n_flags, experiment.n_missed, experiment.n_corrupt);
+		}
+		else if (!strcmp(command, "status"))
+		{
+			replyCommand(client, "OK %s %s/%s %i %i %i", is_running ? "running" : "idle", experiment.storageDir, 
+				experiment.timeStamp[0] ? experiment.timeStamp : "-", experiment.n_flags, experiment.n_missed, experiment.n_corrupt);
+		}
+		else if (!strcmp(command, "config"))
+		{
+			char* lo = strtok_r(NULL, " ", &save);
+			char* rf = strtok_r(NULL, " ", &save);
+			
+			if (is_running)
+			{
+				replyCommand(client, "ERR collection running");
+			}
+			else if (!lo || !rf)
+			{
+				replyCommand(client, "ERR config <lo.ini> <rf.ini>");
+			}
+			else if (!isRampFile(lo) || !isRampFile(rf))
+			{
+				//getParameters exits on a missing file
+				replyCommand(client, "ERR no such ramp file");
+			}
+			else
+			{
+				free(config_files[0]);
+				free(config_files[1]);
+				config_files[0] = strdup(lo);
+				config_files[1] = strdup(rf);
+				synthOne.parameterFile = config_files[0];
+				synthTwo.parameterFile = config_files[1];
+				loadSynths();
+				programSynths();
+				
+				//a new ramp chain changes the trigger period
+				if (experiment.is_calibration)
+				{
+					calibrateTrigger(&synthOne, &synthTwo);
+					applyCalibration(&experiment, experiment.ns_requested);
+				}
+				
+				replyCommand(client, "OK %u %i", experiment.ns_ext_buffer, experiment.u_max_loop);
+			}
+		}
+		else
+		{
+			replyCommand(client, "ERR unknown command %s", command);
+		}
+		
+		closeCommand(client);
+	}
+	
+	dnitDaemon();
 }
 
 
 void splash(void)
 {
-	system("clear\n");
+	//scripted launches keep the terminal history
+	if (!is_headless)
+		printf("\033[2J\033[H");
+	
 	printf("UCT RPC: %s\n", VERSION);
 	printf("--------------\n");
-
+	
 	if (experiment.is_debug_mode)
 	{
 		cprint("[OK] ", BRIGHT, GREEN);
@@ -330,7 +932,7 @@ void splash(void)
 		cprint("[!!] ", BRIGHT, RED);
 		printf("Debug mode disabled.\n");
 	}
-
+	
 	if (experiment.is_imu)
 	{
 		cprint("[OK] ", BRIGHT, GREEN);
@@ -346,16 +948,34 @@ void splash(void)
 
 void help(void)
 {
-	system("clear\n");
+	printf("\033[2J\033[H");
 	printf("UCT RPC: %s\n", VERSION);
 	printf("--------------\n");
 	printf(" -h: display this help screen\n");
 	printf(" -d: enable debug mode\n");
 	printf(" -i: enable imu mode\n");
+	printf(" -U: serial port of the imu \t(default: %s)\n", UART_DEVICE);
 	printf(" -l: name of local oscillator (lo) synth parameter file\n");
 	printf(" -t: name of radio frequency (rf) synth parameter file\n");
 	printf(" -r: write output files to /tmp\n");
 	printf(" -c: input adc channel \t(0 or 1)\n");	
+	printf(" -p: pack 14-bit samples on disk\n");
+	printf(" -z: compress samples on disk (lossless)\n");
+	printf(" -s: roll over to a new ext segment every n MB\n");
+	printf(" -g: roll over to a new ext segment every n ramps\n");
+	printf(" -m: write placeholder ramps for missed triggers\n");
+	printf(" -n: adc samples per ramp \t(default: largest that keeps up)\n");
+	printf(" -k: skip startup calibration\n");
+	printf(" -R: record n ramps without prompting, triggered immediately\n");
+	printf(" -C: comment written to the summary with -R\n");
+	printf(" -V: publish every nth ramp to the live preview %s\n", PREVIEW_NAME);
+	printf(" -T: write a chrome trace of the capture pipeline to trace.json\n");
+	printf(" -E: count cycles, instructions, cache/tlb misses and context switches per phase\n");
+	printf(" -F: start even if the storage pre-flight or calibration check fails\n");
+	printf(" -S: record the bursts of a schedule file back to back\n");
+	printf(" -D: run as a daemon controlled by rpcctl over %s\n", DAEMON_SOCKET);
+	printf(" -B: benchmark throughput with an internal trigger (no synths)\n");
+	printf(" -P: plan capacity offline for every -l/-t pair \t(sd card GB, 0 for free space)\n");
 	exit(EXIT_SUCCESS);	
 }
 
@@ -363,27 +983,43 @@ void help(void)
 void parse_uart(void)
 {		
 	FILE *imuFile;
-
+	
 	if (!(imuFile = fopen(experiment.imu_filename, "wb"))) 
 	{		
 		cprint("[!!] ", BRIGHT, RED);
 		printf("IMU file open failed.\n");
 		exit(EXIT_FAILURE);
 	}
-
+	
+	traceThread("imu");
+	openCounters();
+	resetImuStats();
+	
 	//while experiment is active
 	while (is_experiment_active)
 	{
 		//prevent intensive processing while is_imu_allowed is false
 		//while(!is_imu_allowed);
 		
+		PhaseProbe phase;
+		
+		beginPhase(&phase);
 		int rx_size = getUART();
+		//stamp the bytes on arrival, before the sidecar write delays them
+		double t_read = monotonicTime();
+		endPhase(TRACE_UART_READ, &phase, rx_size);
 		
+		beginPhase(&phase);
 		fwrite(uart_buffer, sizeof(uint8_t), rx_size, imuFile);
+		endPhase(TRACE_IMU_WRITE, &phase, rx_size);
 		
-		usleep(1e3);
+		//decode attitude, position and velocity for the pose sidecar
+		beginPhase(&phase);
+		processUART(uart_buffer, rx_size, t_read);
+		endPhase(TRACE_IMU_DECODE, &phase, rx_size);
 	}
-
+	
+	closeCounters();
 	fclose(imuFile);
 }
 
@@ -395,7 +1031,7 @@ void parse_options(int argc, char *argv[])
 	int is_synth_two = 0;
 	
 	//retrieve command-line options
-    while ((opt = getopt(argc, argv, "dib:c:t:l:rh")) != -1 )
+    while ((opt = getopt(argc, argv, "dib:c:t:l:rpzs:g:mn:kR:C:V:TEFU:P:BDS:h")) != -1 )
     {
         switch (opt)
         {
@@ -408,6 +1044,67 @@ void parse_options(int argc, char *argv[])
             case 'i':
                 experiment.is_imu = 1;
                 break;
+            case 'p':
+                experiment.sample_format = SAMPLE_FORMAT_PACK14;
+                break;
+            case 'z':
+                experiment.sample_format = SAMPLE_FORMAT_RICE;
+                break;
+			case 's':
+				experiment.segment_size = atof(optarg);
+				break;
+			case 'g':
+				experiment.segment_ramps = atoi(optarg);
+				break;
+			case 'm':
+				experiment.is_placeholder = 1;
+				break;
+			case 'n':
+				experiment.ns_requested = atoi(optarg);
+				if (experiment.ns_requested < CALIBRATION_MIN_SAMPLES || experiment.ns_requested > ADC_BUFFER_SIZE)
+				{
+					cprint("[!!] ", BRIGHT, RED);
+					printf("-n takes %i to %i samples per ramp.\n", CALIBRATION_MIN_SAMPLES, ADC_BUFFER_SIZE);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'k':
+				experiment.is_calibration = 0;
+				break;
+			case 'R':
+				experiment.n_ramps = atoi(optarg);
+				is_headless = 1;
+				break;
+			case 'C':
+				headless_comment = optarg;
+				break;
+			case 'V':
+				experiment.preview_every = atoi(optarg);
+				break;
+			case 'T':
+				experiment.is_trace = 1;
+				break;
+			case 'E':
+				experiment.is_counters = 1;
+				break;
+			case 'F':
+				experiment.is_preflight_forced = 1;
+				break;
+			case 'U':
+				experiment.uart_device = optarg;
+				break;
+			case 'P':
+				plan_card_size = atof(optarg);
+				break;
+			case 'B':
+				is_benchmark = 1;
+				break;
+			case 'D':
+				is_daemon = 1;
+				break;
+			case 'S':
+				schedule_filename = optarg;
+				break;
 			case 'c':
 				experiment.adc_channel = atoi(optarg);
 				break;
@@ -416,14 +1113,18 @@ void parse_options(int argc, char *argv[])
 				synthTwo.parameterFile = optarg;
 				is_synth_one = 1;
 				is_synth_two = 1;
+				if (n_lo_files < PLAN_MAX_FILES) lo_files[n_lo_files++] = optarg;
+				if (n_rf_files < PLAN_MAX_FILES) rf_files[n_rf_files++] = optarg;
 				break;
 			case 'l':
 				is_synth_one = 1;
 				synthOne.parameterFile = optarg;
+				if (n_lo_files < PLAN_MAX_FILES) lo_files[n_lo_files++] = optarg;
 				break;
 			case 't':
 				is_synth_two = 1;
 				synthTwo.parameterFile = optarg;
+				if (n_rf_files < PLAN_MAX_FILES) rf_files[n_rf_files++] = optarg;
 				break;
 			case 'h':
 				help();
@@ -436,7 +1137,7 @@ void parse_options(int argc, char *argv[])
         }
     }
 
-    if (is_synth_one + is_synth_two != 2)
+    if ((is_synth_one + is_synth_two != 2) && !is_benchmark)
     {
 		cprint("[!!] ", BRIGHT, RED);
 		printf("A .ini parameter file must be provided for each synthesizer.\n");
@@ -0,0 +1,81 @@
+#include "npy.h"
+
+
+//create an array of item_size elements, mapped read-write
+int createNpy(NpyMap* npy, const char* filename, const char* descr, const uint64_t* shape, int n_dims, size_t item_size)
+{
+	char dims[128] = "(";
+	char header[512];
+	uint64_t n_items = 1;
+	
+	memset(npy, 0, sizeof(NpyMap));
+	
+	if (n_dims < 1 || n_dims > NPY_MAX_DIMS)
+		return 0;
+	
+	//python tuple, a single dimension keeps its trailing comma
+	for (int i = 0; i < n_dims; i++)
+	{
+		snprintf(dims + strlen(dims), sizeof(dims) - strlen(dims), (i + 1 < n_dims) ? "%llu, " : (n_dims == 1) ? "%llu,)" : "%llu)", (unsigned long long)shape[i]);
+		n_items *= shape[i];
+	}
+	
+	//magic, version 1.0, little-endian header length, dict padded with spaces and ended by a newline
+	int length = snprintf(header + 10, sizeof(header) - 10 - NPY_ALIGN, "{'descr': %s, 'fortran_order': False, 'shape': %s, }", descr, dims);
+	
+	if (length < 0 || length >= (int)sizeof(header) - 10 - NPY_ALIGN)
+		return 0;
+	
+	int padded = ((10 + length + 1 + NPY_ALIGN - 1)/NPY_ALIGN)*NPY_ALIGN;
+	
+	memcpy(header, NPY_MAGIC, 6);
+	header[6] = 1;
+	header[7] = 0;
+	header[8] = (padded - 10) & 0xFF;
+	header[9] = (padded - 10) >> 8;
+	memset(header + 10 + length, ' ', padded - 10 - length);
+	header[padded - 1] = '\n';
+	
+	npy->header_size = padded;
+	npy->size = padded + n_items*item_size;
+	
+	if ((npy->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+		return 0;
+	
+	if (ftruncate(npy->fd, npy->size))
+	{
+		close(npy->fd);
+		return 0;
+	}
+	
+	npy->base = (uint8_t*)mmap(NULL, npy->size, PROT_READ | PROT_WRITE, MAP_SHARED, npy->fd, 0);
+	
+	if (npy->base == MAP_FAILED)
+	{
+		close(npy->fd);
+		return 0;
+	}
+	
+	memcpy(npy->base, header, padded);
+	npy->data = npy->base + padded;
+	
+	return 1;
+}
+
+
+//write back and unmap, returns 0 if the data could not be written
+int closeNpy(NpyMap* npy)
+{
+	int is_written = 1;
+	
+	if (npy->base && npy->base != MAP_FAILED)
+	{
+		is_written &= !msync(npy->base, npy->size, MS_SYNC);
+		munmap(npy->base, npy->size);
+	}
+	
+	is_written &= !close(npy->fd);
+	memset(npy, 0, sizeof(NpyMap));
+	
+	return is_written;
+}
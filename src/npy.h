@@ -0,0 +1,38 @@
+#ifndef NPY_H
+#define NPY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+//numpy .npy arrays for the offline tools
+//the file is sized up front and mapped, so worker threads fill their rows in
+//place. the header is a version 1.0 python dict padded to 64 bytes, followed by
+//the row-major little-endian data, which np.load, np.memmap and matlab's
+//fread(..., 'skip') all read directly.
+//
+//descr is the numpy type as a python literal, e.g. "'<i2'", "'<f4'" or
+//"[('ramp', '<u4'), ('t', '<f8')]" for structured rows. shape holds n_dims
+//sizes, slowest varying first.
+
+#define NPY_MAGIC				"\x93NUMPY"
+#define NPY_ALIGN				64
+#define NPY_MAX_DIMS			4
+
+typedef struct
+{
+	int fd;
+	uint8_t* base;
+	size_t size;
+	size_t header_size;
+	void* data;								//first element
+} NpyMap;
+
+int  createNpy(NpyMap* npy, const char* filename, const char* descr, const uint64_t* shape, int n_dims, size_t item_size);
+int  closeNpy(NpyMap* npy);
+
+#endif
@@ -0,0 +1,119 @@
+#include "pack.h"
+
+static void packGroup(const int16_t* samples, uint8_t* packed);
+static void unpackGroup(const uint8_t* packed, int16_t* samples);
+
+
+size_t packedSize(uint32_t n_samples)
+{
+	return ((n_samples + PACK_GROUP_SAMPLES - 1)/PACK_GROUP_SAMPLES)*PACK_GROUP_BYTES;
+}
+
+
+void packSamples(const int16_t* samples, uint8_t* packed, uint32_t n_samples)
+{
+	uint32_t n_groups = n_samples/PACK_GROUP_SAMPLES;
+	uint32_t g = 0;
+	
+#ifdef __ARM_NEON
+	const uint16x8_t mask = vdupq_n_u16(0x3FFF);
+	
+	//the 8 byte stores overlap the next group, so the final group is packed separately
+	for (; g + 1 < n_groups; g++)
+	{
+		uint16x8_t u = vandq_u16(vreinterpretq_u16_s16(vld1q_s16(&samples[g*PACK_GROUP_SAMPLES])), mask);
+		
+		//pairs of samples into 28 bits of each 32-bit lane
+		uint32x4_t w = vreinterpretq_u32_u16(u);
+		w = vsliq_n_u32(w, vshrq_n_u32(w, 16), 14);
+		
+		//pairs of pairs into 56 bits of each 64-bit lane
+		uint64x2_t d = vreinterpretq_u64_u32(w);
+		d = vsliq_n_u64(d, vshrq_n_u64(d, 32), 28);
+		
+		vst1_u8(&packed[g*PACK_GROUP_BYTES], vreinterpret_u8_u64(vget_low_u64(d)));
+		vst1_u8(&packed[g*PACK_GROUP_BYTES + 7], vreinterpret_u8_u64(vget_high_u64(d)));
+	}
+#endif
+	
+	for (; g < n_groups; g++)
+		packGroup(&samples[g*PACK_GROUP_SAMPLES], &packed[g*PACK_GROUP_BYTES]);
+	
+	//zero pad the last partial group
+	if (n_samples % PACK_GROUP_SAMPLES)
+	{
+		int16_t group[PACK_GROUP_SAMPLES] = {0};
+		
+		memcpy(group, &samples[n_groups*PACK_GROUP_SAMPLES], (n_samples % PACK_GROUP_SAMPLES)*sizeof(int16_t));
+		packGroup(group, &packed[n_groups*PACK_GROUP_BYTES]);
+	}
+}
+
+
+void unpackSamples(const uint8_t* packed, int16_t* samples, uint32_t n_samples)
+{
+	uint32_t n_groups = n_samples/PACK_GROUP_SAMPLES;
+	uint32_t g = 0;
+	
+#ifdef __ARM_NEON
+	//the 16 byte load reads past the group, so the final group is unpacked separately
+	for (; g + 1 < n_groups; g++)
+	{
+		uint8x16_t bytes = vld1q_u8(&packed[g*PACK_GROUP_BYTES]);
+		
+		//move each 7 byte half into its own 64-bit lane
+		uint64x2_t d = vcombine_u64(vreinterpret_u64_u8(vget_low_u8(bytes)), vreinterpret_u64_u8(vget_low_u8(vextq_u8(bytes, bytes, 7))));
+		
+		//split 56 bits into two 28-bit halves, one per 32-bit lane
+		uint32x4_t w = vreinterpretq_u32_u64(vsliq_n_u64(vandq_u64(d, vdupq_n_u64(0x0FFFFFFF)), vshrq_n_u64(d, 28), 32));
+		
+		//split 28 bits into two 14-bit samples, one per 16-bit lane
+		uint16x8_t u = vreinterpretq_u16_u32(vsliq_n_u32(vandq_u32(w, vdupq_n_u32(0x3FFF)), vshrq_n_u32(w, 14), 16));
+		
+		//sign extend from 14 bits
+		int16x8_t s = vshrq_n_s16(vshlq_n_s16(vreinterpretq_s16_u16(u), 2), 2);
+		vst1q_s16(&samples[g*PACK_GROUP_SAMPLES], s);
+	}
+#endif
+	
+	for (; g < n_groups; g++)
+		unpackGroup(&packed[g*PACK_GROUP_BYTES], &samples[g*PACK_GROUP_SAMPLES]);
+	
+	if (n_samples % PACK_GROUP_SAMPLES)
+	{
+		int16_t group[PACK_GROUP_SAMPLES];
+		
+		unpackGroup(&packed[n_groups*PACK_GROUP_BYTES], group);
+		memcpy(&samples[n_groups*PACK_GROUP_SAMPLES], group, (n_samples % PACK_GROUP_SAMPLES)*sizeof(int16_t));
+	}
+}
+
+
+static void packGroup(const int16_t* samples, uint8_t* packed)
+{
+	for (int half = 0; half < 2; half++)
+	{
+		uint64_t bits = 0;
+		
+		for (int i = 0; i < 4; i++)
+			bits |= (uint64_t)((uint16_t)samples[4*half + i] & 0x3FFF) << (14*i);
+		
+		for (int b = 0; b < 7; b++)
+			packed[7*half + b] = bits >> (8*b);
+	}
+}
+
+
+static void unpackGroup(const uint8_t* packed, int16_t* samples)
+{
+	for (int half = 0; half < 2; half++)
+	{
+		uint64_t bits = 0;
+		
+		for (int b = 0; b < 7; b++)
+			bits |= (uint64_t)packed[7*half + b] << (8*b);
+		
+		for (int i = 0; i < 4; i++)
+			samples[4*half + i] = (int16_t)((uint16_t)(bits >> (14*i)) << 2) >> 2;
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+//14-bit sample packing
+//groups of 8 samples are stored in 14 bytes as a little-endian bit stream,
+//sample i occupying bits 14*i to 14*i + 13. a ramp is padded with zero
+//samples to a multiple of 8.
+
+#define PACK_GROUP_SAMPLES		8
+#define PACK_GROUP_BYTES		14
+
+size_t packedSize(uint32_t n_samples);
+void   packSamples(const int16_t* samples, uint8_t* packed, uint32_t n_samples);
+void   unpackSamples(const uint8_t* packed, int16_t* samples, uint32_t n_samples);
+
+#endif
@@ -0,0 +1,218 @@
+#include "plan.h"
+
+//offline check of ramp profiles against the capture loop budget and the storage.
+//ramp durations follow calculateRampParameters: length in phase detector cycles,
+//doubled when the doubler bit is set. the adc triggers on the rising edge of the
+//ramp flag, i.e. at the start of a flagged ramp that follows an unflagged one.
+
+static Synthesizer plan_synth[2];
+
+
+double rampDuration(const Synthesizer *synth, int ramp)
+{
+	return synth->ramps[ramp].length*(synth->ramps[ramp].doubler ? 2 : 1)/PLAN_PFD_FREQUENCY;
+}
+
+
+//follow the next links from ramp0 until a ramp repeats, returns 1 if the repeating part raises
+//the trigger flag without waiting on an external trigger, 0 if it never flags or waits
+int traceRampChain(const Synthesizer *synth, RampChain *chain)
+{
+	int visited[MAX_RAMPS];
+	int order[MAX_RAMPS];
+	int n = 0;
+	int ramp = 0;
+	
+	memset(chain, 0, sizeof(RampChain));
+	chain->trigger_ramp = -1;
+	
+	for (int i = 0; i < MAX_RAMPS; i++)
+		visited[i] = -1;
+	
+	while (visited[ramp] < 0)
+	{
+		visited[ramp] = n;
+		order[n++] = ramp;
+		ramp = synth->ramps[ramp].next % MAX_RAMPS;
+	}
+	
+	//ramps from the first repeated one onwards form the cycle
+	int first = visited[ramp];
+	double t = 0;
+	double t_edge[MAX_RAMPS];
+	
+	chain->n_ramps = n - first;
+	chain->is_free_running = 1;
+	
+	for (int i = first; i < n; i++)
+	{
+		const int current = order[i];
+		const int previous = order[(i == first) ? n - 1 : i - 1];
+		
+		if (synth->ramps[current].trigger)
+			chain->is_free_running = 0;
+		
+		if ((synth->ramps[current].flag & PLAN_TRIGGER_FLAG) && !(synth->ramps[previous].flag & PLAN_TRIGGER_FLAG))
+		{
+			if (chain->n_triggers == 0)
+				chain->trigger_ramp = previous;
+			
+			t_edge[chain->n_triggers++] = t;
+		}
+		
+		t += rampDuration(synth, current);
+	}
+	
+	chain->cycle = t;
+	
+	if (chain->n_triggers == 0)
+		return 0;
+	
+	chain->min_interval = chain->cycle;
+	
+	for (int i = 1; i < chain->n_triggers; i++)
+		chain->min_interval = fmin(chain->min_interval, t_edge[i] - t_edge[i - 1]);
+	
+	if (chain->n_triggers > 1)
+		chain->min_interval = fmin(chain->min_interval, chain->cycle - t_edge[chain->n_triggers - 1] + t_edge[0]);
+	
+	return chain->is_free_running;
+}
+
+
+//keys of the synth summary section describing the ramp the adc samples, for range calibration offline.
+//the adc trigger delay of -ADC_BUFFER_SIZE/2 places the whole record before the flag edge, so the
+//sampled ramp is the one ending there
+void writeSweepSummary(FILE* summaryFile, const Synthesizer *synth)
+{
+	RampChain chain;
+	traceRampChain(synth, &chain);
+	int ramp = chain.trigger_ramp;
+	
+	fprintf(summaryFile, "trigger_ramp = %i\r\n", ramp);
+	//bit 31 of the increment holds the doubler, bnwOut expects the 30-bit two's complement value
+	fprintf(summaryFile, "ramp_bandwidth = %.3f\r\n", (ramp < 0) ? 0 : bnwOut((uint32_t)synth->ramps[ramp].increment & 0x7FFFFFFF, synth->ramps[ramp].length));
+	fprintf(summaryFile, "ramp_duration = %.3f\r\n", (ramp < 0) ? 0 : rampDuration(synth, ramp));
+}
+
+
+static int loadSynth(Synthesizer *synth, int number, char* filename, Experiment *experiment)
+{
+	synth->number = number;
+	synth->parameterFile = filename;
+	getParameters(synth);
+	calculateRampParameters(synth, experiment);
+	
+	return 1;
+}
+
+
+//writer thread cost of one MB of raw samples on the auxiliary core [s]
+static double writerCost(int sample_format)
+{
+	switch (sample_format)
+	{
+		case SAMPLE_FORMAT_PACK14:	return 1/PLAN_PACK_RATE;
+		case SAMPLE_FORMAT_RICE:	return 1/PLAN_RICE_RATE;
+		default:					return 1/PLAN_COPY_RATE;
+	}
+}
+
+
+//report pass or fail for every combination of lo and rf files, returns the number that fail
+int planCapacity(Experiment *experiment, char** lo_files, int n_lo, char** rf_files, int n_rf, double card_size)
+{
+	double refill_per_sample = (double)experiment->decFactor/ADC_RATE*1e6;
+	double per_sample = PLAN_TRANSFER_PER_SAMPLE + ADC_REFILL_MARGIN*refill_per_sample;
+	int n_failed = 0;
+	
+	//free space of the storage directory when no card size is given
+	if (card_size <= 0)
+	{
+		struct statvfs info;
+		
+		if (!statvfs(experiment->storageDir, &info))
+			card_size = (double)info.f_bavail*info.f_frsize/1e9;
+	}
+	
+	printf("Transfer model: %.2f us + %.4f us/sample, sd card %.1f MB/s, %.1f GB\n\n", PLAN_TRANSFER_FIXED, 
+		PLAN_TRANSFER_PER_SAMPLE, PLAN_SD_RATE, card_size);
+	printf("%-14s %-14s %8s %8s %8s %8s %7s %8s %6s  %s\n", "lo", "rf", "prf", "samples", "loop", "budget", 
+		"MB/s", "fill", "aux", "result");
+	printf("%-14s %-14s %8s %8s %8s %8s %7s %8s %6s\n", "", "", "[Hz]", "", "[us]", "[us]", "", "[min]", "free");
+	
+	for (int i = 0; i < n_lo; i++)
+	{
+		for (int j = 0; j < n_rf; j++)
+		{
+			RampChain chain[2];
+			int is_chain[2];
+			
+			loadSynth(&plan_synth[0], 1, lo_files[i], experiment);
+			loadSynth(&plan_synth[1], 2, rf_files[j], experiment);
+			is_chain[0] = traceRampChain(&plan_synth[0], &chain[0]);
+			is_chain[1] = traceRampChain(&plan_synth[1], &chain[1]);
+			
+			printf("%-14s %-14s ", lo_files[i], rf_files[j]);
+			
+			if (!is_chain[0] && !is_chain[1])
+			{
+				n_failed++;
+				cprint("FAIL", BRIGHT, RED);
+				printf(" no free running trigger flag\n");
+				continue;
+			}
+			
+			//the trigger follows whichever synth flags it, the faster one sets the budget
+			double interval = is_chain[0] ? chain[0].min_interval : chain[1].min_interval;
+			double cycle = is_chain[0] ? chain[0].cycle : chain[1].cycle;
+			int n_triggers = is_chain[0] ? chain[0].n_triggers : chain[1].n_triggers;
+			
+			if (is_chain[0] && is_chain[1] && chain[1].min_interval < interval)
+			{
+				interval = chain[1].min_interval;
+				cycle = chain[1].cycle;
+				n_triggers = chain[1].n_triggers;
+			}
+			
+			double prf = n_triggers/cycle*1e6;
+			double budget = CALIBRATION_LOOP*interval;
+			uint32_t ns = experiment->ns_requested;
+			
+			//same choice as applyCalibration
+			if (!ns)
+			{
+				double ns_max = fmin((budget - PLAN_TRANSFER_FIXED)/per_sample, ADC_BUFFER_SIZE);
+				ns = (ns_max > 0) ? ((uint32_t)ns_max & ~7u) : 0;
+			}
+			
+			double loop = PLAN_TRANSFER_FIXED + ns*per_sample;
+			
+			//stored bytes per ramp, compressed formats are planned at their worst case
+			double ramp_bytes = (experiment->sample_format == SAMPLE_FORMAT_PACK14) ? packedSize(ns) : ns*sizeof(int16_t);
+			double raw_rate = prf*ns*sizeof(int16_t)/1e6;
+			double write_rate = prf*(ramp_bytes + sizeof(RampMeta))/1e6;
+			double fill = card_size*1e3/write_rate/60;
+			double aux = 1 - raw_rate*writerCost(experiment->sample_format) - write_rate/PLAN_IO_RATE;
+			
+			int is_pass = ns && (loop <= budget) && (write_rate <= PLAN_SD_RATE) && (aux >= PLAN_IMU_HEADROOM);
+			
+			printf("%8.1f %8u %8.1f %8.1f %7.2f %8.1f %5.0f%%  ", prf, ns, loop, budget, write_rate, fill, 100*aux);
+			
+			if (is_pass)
+			{
+				cprint("PASS", BRIGHT, GREEN);
+				printf("\n");
+			}
+			else
+			{
+				n_failed++;
+				cprint("FAIL", BRIGHT, RED);
+				printf("%s%s%s\n", (loop > budget || !ns) ? " loop" : "", (write_rate > PLAN_SD_RATE) ? " sd" : "", 
+					(aux < PLAN_IMU_HEADROOM) ? " imu" : "");
+			}
+		}
+	}
+	
+	return n_failed;
+}
@@ -0,0 +1,43 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/statvfs.h>
+
+#include "controller.h"
+#include "calibrate.h"
+#include "capture.h"
+#include "pack.h"
+#include "colour.h"
+
+#define PLAN_MAX_FILES			8			//-l and -t files compared in one run
+#define PLAN_PFD_FREQUENCY		100.0		//phase detector frequency [MHz], one ramp length cycle
+#define PLAN_TRIGGER_FLAG		0x01		//ramp flag bit wired to the adc trigger
+#define PLAN_TRANSFER_FIXED		3.5			//transfer model fitted to timing.txt [us]
+#define PLAN_TRANSFER_PER_SAMPLE 0.1956		//[us/sample]
+#define PLAN_SD_RATE			10.0		//sustained sd card write rate [MB/s]
+#define PLAN_COPY_RATE			400.0		//writer thread rates on the auxiliary core [MB/s of raw samples]
+#define PLAN_PACK_RATE			150.0
+#define PLAN_RICE_RATE			40.0
+#define PLAN_IO_RATE			200.0		//cpu cost of buffered writes [MB/s]
+#define PLAN_IMU_HEADROOM		0.25		//fraction of the auxiliary core kept free for the imu thread
+
+typedef struct
+{
+	int n_ramps;							//ramps in the repeating part of the chain
+	double cycle;							//duration of the repeating part [us]
+	int n_triggers;							//rising edges of the trigger flag per cycle
+	double min_interval;					//shortest interval between trigger edges [us]
+	int is_free_running;					//repeating part does not wait on a trigger
+	int trigger_ramp;						//ramp ending at the first trigger edge, the adc records the samples before the edge, -1 if none
+} RampChain;
+
+double rampDuration(const Synthesizer *synth, int ramp);
+int traceRampChain(const Synthesizer *synth, RampChain *chain);
+void writeSweepSummary(FILE* summaryFile, const Synthesizer *synth);
+int planCapacity(Experiment *experiment, char** lo_files, int n_lo, char** rf_files, int n_rf, double card_size);
+
+#endif
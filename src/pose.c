@@ -0,0 +1,290 @@
+#include "pose.h"
+
+//window of decoded imu samples, written by the imu thread and read by the pose thread
+static ImuSample window[POSE_WINDOW_SIZE];
+static int window_head = 0;
+static int window_count = 0;
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//single producer (capture loop) single consumer (pose thread) queue of ramp timestamps
+static RampStamp queue[POSE_QUEUE_SIZE];
+static uint32_t queue_head = 0;
+static uint32_t queue_tail = 0;
+static int queue_dropped = 0;
+
+static FILE* poseFile = NULL;
+static FILE* sampleFile = NULL;
+static pthread_t pose_thread;
+static int is_pose_active = 0;
+
+static void* runPose(void* arg);
+static int findPose(RampStamp* stamp, PoseRecord* pose);
+
+
+int initPose(const char* pose_filename, const char* sample_filename, int cpu)
+{
+	if (!(poseFile = fopen(pose_filename, "wb"))) 
+	{		
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Pose file open failed.\n");
+		return 0;
+	}
+	
+	if (!(sampleFile = fopen(sample_filename, "wb"))) 
+	{		
+		cprint("[!!] ", BRIGHT, RED);
+		printf("IMU sample file open failed.\n");
+		fclose(poseFile);
+		poseFile = NULL;
+		return 0;
+	}
+	
+	window_head = 0;
+	window_count = 0;
+	queue_head = 0;
+	queue_tail = 0;
+	queue_dropped = 0;
+	is_pose_active = 1;
+	
+	if (pthread_create(&pose_thread, NULL, runPose, NULL))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Error launching pose thread.\n");
+		fclose(poseFile);
+		fclose(sampleFile);
+		poseFile = NULL;
+		sampleFile = NULL;
+		return 0;
+	}
+	
+	//keep interpolation off the acquisition core
+	pinThread(pose_thread, cpu);
+	
+	return 1;
+}
+
+
+void dnitPose(void)
+{
+	if (poseFile == NULL)
+		return;
+	
+	//pose thread drains the remaining ramps before exiting
+	is_pose_active = 0;
+	pthread_join(pose_thread, NULL);
+	fclose(poseFile);
+	fclose(sampleFile);
+	poseFile = NULL;
+	sampleFile = NULL;
+	
+	if (queue_dropped > 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Ramps without pose: %i\n", queue_dropped);
+	}
+}
+
+
+//called from the imu thread for every decoded attitude update
+void pushImuSample(ImuSample* sample)
+{
+	if (sampleFile == NULL)
+		return;
+	
+	gpsTime(sample->t, &sample->t_gps);
+	fwrite(sample, sizeof(ImuSample), 1, sampleFile);
+	
+	pthread_mutex_lock(&window_lock);
+	
+	window_head = (window_head + 1) % POSE_WINDOW_SIZE;
+	window[window_head] = *sample;
+	
+	if (window_count < POSE_WINDOW_SIZE) 
+		window_count++;
+	
+	pthread_mutex_unlock(&window_lock);
+}
+
+
+//called from the capture loop, never blocks
+int pushRamp(uint32_t ramp, double t)
+{
+	uint32_t head = __atomic_load_n(&queue_head, __ATOMIC_RELAXED);
+	uint32_t tail = __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE);
+	
+	if (head - tail == POSE_QUEUE_SIZE)
+	{
+		queue_dropped++;
+		return 0;
+	}
+	
+	queue[head & (POSE_QUEUE_SIZE - 1)].ramp = ramp;
+	queue[head & (POSE_QUEUE_SIZE - 1)].t = t;
+	
+	__atomic_store_n(&queue_head, head + 1, __ATOMIC_RELEASE);
+	
+	return 1;
+}
+
+
+int getPoseDropped(void)
+{
+	return queue_dropped;
+}
+
+
+static void* runPose(void* arg)
+{
+	PoseRecord pose;
+	
+	while (1)
+	{
+		uint32_t head = __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE);
+		uint32_t tail = __atomic_load_n(&queue_tail, __ATOMIC_RELAXED);
+		
+		if (head == tail)
+		{
+			if (!is_pose_active) 
+				break;
+			
+			usleep(1e3);
+			continue;
+		}
+		
+		RampStamp stamp = queue[tail & (POSE_QUEUE_SIZE - 1)];
+		
+		//wait for the imu window to catch up with the ramp
+		if (!findPose(&stamp, &pose))
+		{
+			usleep(1e3);
+			continue;
+		}
+		
+		gpsTime(pose.t, &pose.t_gps);
+		fwrite(&pose, sizeof(PoseRecord), 1, poseFile);
+		
+		__atomic_store_n(&queue_tail, tail + 1, __ATOMIC_RELEASE);
+	}
+	
+	return NULL;
+}
+
+
+//returns 0 if the window does not cover the ramp yet and it is still worth waiting
+static int findPose(RampStamp* stamp, PoseRecord* pose)
+{
+	int is_waiting = is_pose_active && (monotonicTime() - stamp->t < POSE_MAX_WAIT);
+	
+	memset(pose, 0, sizeof(PoseRecord));
+	pose->ramp = stamp->ramp;
+	pose->t = stamp->t;
+	
+	pthread_mutex_lock(&window_lock);
+	
+	if (window_count == 0)
+	{
+		pthread_mutex_unlock(&window_lock);
+		
+		if (is_waiting) 
+			return 0;
+		
+		pose->flags = POSE_NO_IMU;
+		return 1;
+	}
+	
+	ImuSample* newest = &window[window_head];
+	
+	if (newest->t < stamp->t)
+	{
+		if (is_waiting)
+		{
+			pthread_mutex_unlock(&window_lock);
+			return 0;
+		}
+		
+		interpolatePose(newest, newest, stamp->t, pose);
+		pose->flags = POSE_EXTRAPOLATED;
+		pthread_mutex_unlock(&window_lock);
+		return 1;
+	}
+	
+	//search backwards for the pair of samples bracketing the ramp
+	int after = window_head;
+	
+	for (int i = 1; i < window_count; i++)
+	{
+		int before = (window_head - i + POSE_WINDOW_SIZE) % POSE_WINDOW_SIZE;
+		
+		if (window[before].t <= stamp->t)
+		{
+			interpolatePose(&window[before], &window[after], stamp->t, pose);
+			pthread_mutex_unlock(&window_lock);
+			return 1;
+		}
+		
+		after = before;
+	}
+	
+	//ramp is older than the whole window
+	interpolatePose(&window[after], &window[after], stamp->t, pose);
+	pose->flags = POSE_EXTRAPOLATED;
+	pthread_mutex_unlock(&window_lock);
+	
+	return 1;
+}
+
+
+//quaternion slerp for attitude, linear interpolation for position and velocity
+void interpolatePose(ImuSample* before, ImuSample* after, double t, PoseRecord* pose)
+{
+	double span = after->t - before->t;
+	double u = (span > 0) ? (t - before->t)/span : 0;
+	
+	float q1[4];
+	float dot = 0;
+	
+	for (int i = 0; i < 4; i++) 
+	{
+		q1[i] = after->quat[i];
+		dot += before->quat[i]*q1[i];
+	}
+	
+	//take the shortest path
+	if (dot < 0)
+	{
+		for (int i = 0; i < 4; i++) q1[i] = -q1[i];
+		dot = -dot;
+	}
+	
+	double w0 = 1 - u;
+	double w1 = u;
+	
+	//fall back to normalised linear interpolation for nearly identical attitudes
+	if (dot < 0.9995)
+	{
+		double theta = acos(dot);
+		w0 = sin((1 - u)*theta)/sin(theta);
+		w1 = sin(u*theta)/sin(theta);
+	}
+	
+	double norm = 0;
+	
+	for (int i = 0; i < 4; i++)
+	{
+		pose->quat[i] = w0*before->quat[i] + w1*q1[i];
+		norm += pose->quat[i]*pose->quat[i];
+	}
+	
+	norm = sqrt(norm);
+	
+	for (int i = 0; i < 4; i++) 
+		pose->quat[i] = (norm > 0) ? pose->quat[i]/norm : before->quat[i];
+	
+	for (int i = 0; i < 3; i++)
+	{
+		pose->pos[i] = (1 - u)*before->pos[i] + u*after->pos[i];
+		pose->vel[i] = (1 - u)*before->vel[i] + u*after->vel[i];
+	}
+	
+	pose->flags = POSE_INTERPOLATED;
+}
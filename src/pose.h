@@ -0,0 +1,59 @@
+#ifndef POSE_H
+#define POSE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "controller.h"
+#include "colour.h"
+#include "timebase.h"
+
+#define POSE_WINDOW_SIZE		256			//number of decoded imu samples kept for interpolation
+#define POSE_QUEUE_SIZE			1024		//number of ramp timestamps awaiting a pose (power of 2)
+#define POSE_MAX_WAIT			0.5			//time to wait for imu samples to cover a ramp [s]
+
+#define POSE_INTERPOLATED		0x00
+#define POSE_EXTRAPOLATED		0x01		//ramp lies outside of the imu window, nearest sample used
+#define POSE_NO_IMU				0x02		//no imu samples received yet
+
+typedef struct
+{
+	double t;								//receive time [s, CLOCK_MONOTONIC_RAW]
+	double t_gps;							//receive time [s since utc midnight], -1 before gps lock
+	float quat[4];							//attitude quaternion (a, b, c, d)
+	float pos[3];							//position north, east, up [m]
+	float vel[3];							//velocity north, east, up [m/s]
+} ImuSample;
+
+typedef struct
+{
+	uint32_t ramp;							//ramp index
+	uint32_t flags;							//POSE_* interpolation flags
+	double t;								//ramp trigger time [s, CLOCK_MONOTONIC_RAW]
+	double t_gps;							//ramp trigger time [s since utc midnight], -1 before gps lock
+	float quat[4];
+	float pos[3];
+	float vel[3];
+} PoseRecord;
+
+typedef struct
+{
+	uint32_t ramp;
+	double t;
+} RampStamp;
+
+int  initPose(const char* pose_filename, const char* sample_filename, int cpu);
+void dnitPose(void);
+
+void pushImuSample(ImuSample* sample);
+int  pushRamp(uint32_t ramp, double t);
+int  getPoseDropped(void);
+
+void interpolatePose(ImuSample* before, ImuSample* after, double t, PoseRecord* pose);
+
+#endif
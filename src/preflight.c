@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include "preflight.h"
+
+//storage check before a collection starts. the write benchmark uses the
+//writer's pattern: a file preallocated with fallocate, chunk sized fwrites
+//through stdio, and a final fdatasync so the page cache does not hide the
+//card. it runs once per storage directory, the free space check every time.
+
+static Preflight preflight;
+static char benchmarked_dir[100] = "";
+static double benchmarked_rate = 0;
+static uint32_t benchmarked_block = 0;
+
+
+//write rate of the storage directory [MB/s], 0 if the benchmark file could not be written
+static double benchmarkStorage(const char* directory, uint32_t block_size)
+{
+	char filename[200];
+	uint64_t n_bytes = 0;
+	
+	snprintf(filename, sizeof(filename), "%s/.preflight.bin", directory);
+	
+	FILE* file = fopen(filename, "wb");
+	uint8_t* block = (uint8_t*)calloc(block_size, 1);
+	
+	if (!file || !block)
+	{
+		if (file) fclose(file);
+		free(block);
+		return 0;
+	}
+	
+	fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, PREFLIGHT_BYTES);
+	
+	double t_start = monotonicTime();
+	double t_end = t_start;
+	int is_ok = 1;
+	
+	while (is_ok && n_bytes < PREFLIGHT_BYTES && (t_end - t_start) < PREFLIGHT_TIMEOUT)
+	{
+		is_ok = (fwrite(block, block_size, 1, file) == 1);
+		n_bytes += block_size;
+		t_end = monotonicTime();
+	}
+	
+	is_ok &= !fflush(file) && !fdatasync(fileno(file));
+	t_end = monotonicTime();
+	
+	fclose(file);
+	unlink(filename);
+	free(block);
+	
+	return (is_ok && t_end > t_start) ? n_bytes/(t_end - t_start)/1e6 : 0;
+}
+
+
+//trigger rate from the calibration, or from the ramp chain when calibration was skipped [Hz]
+static double triggerRate(Synthesizer *synth)
+{
+	RampChain chain;
+	
+	if (getCalibration()->trigger_period > 0)
+		return 1e6/getCalibration()->trigger_period;
+	
+	traceRampChain(synth, &chain);
+	
+	return (chain.n_triggers > 0 && chain.cycle > 0) ? chain.n_triggers/chain.cycle*1e6 : 0;
+}
+
+
+//returns 0 if the collection should not start
+int runPreflight(Experiment *experiment, Synthesizer *synth)
+{
+	CaptureHeader header;
+	struct statvfs info;
+	
+	memset(&preflight, 0, sizeof(Preflight));
+	memset(&header, 0, sizeof(CaptureHeader));
+	
+	header.ns_ramp = experiment->ns_ext_buffer;
+	header.sample_format = experiment->sample_format;
+	
+	//compressed formats are checked at their worst case, as planCapacity does
+	double ramp_bytes = captureRampBytes(&header) + sizeof(RampMeta) + (double)sizeof(CaptureChunkHeader)/CAPTURE_CHUNK_RAMPS;
+	
+	preflight.block_size = sizeof(CaptureChunkHeader) + CAPTURE_CHUNK_RAMPS*(sizeof(RampMeta) + captureRampBytes(&header));
+	preflight.required_space = experiment->n_ramps*ramp_bytes/1e6;
+	preflight.prf = triggerRate(synth);
+	preflight.required_rate = preflight.prf*ramp_bytes/1e6;
+	
+	if (!statvfs(experiment->storageDir, &info))
+		preflight.free_space = (double)info.f_bavail*info.f_frsize/1e6;
+	
+	//the card does not change between collections
+	if (strcmp(benchmarked_dir, experiment->storageDir) || benchmarked_block != preflight.block_size)
+	{
+		benchmarked_rate = benchmarkStorage(experiment->storageDir, preflight.block_size);
+		benchmarked_block = preflight.block_size;
+		strncpy(benchmarked_dir, experiment->storageDir, sizeof(benchmarked_dir) - 1);
+	}
+	
+	preflight.write_rate = benchmarked_rate;
+	
+	if (preflight.free_space < PREFLIGHT_SPACE_MARGIN*preflight.required_space)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Not enough free space: %.1f MB needed, %.1f MB free on %s\n", 
+			PREFLIGHT_SPACE_MARGIN*preflight.required_space, preflight.free_space, experiment->storageDir);
+		preflight.result = PREFLIGHT_FAIL;
+	}
+	
+	if (preflight.write_rate <= 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Storage benchmark could not write to %s\n", experiment->storageDir);
+		preflight.result = PREFLIGHT_FAIL;
+	}
+	else if (preflight.required_rate > preflight.write_rate)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Storage too slow: %.2f MB/s needed at %.0f Hz, %.2f MB/s measured\n", 
+			preflight.required_rate, preflight.prf, preflight.write_rate);
+		preflight.result = PREFLIGHT_FAIL;
+	}
+	else if (preflight.required_rate*PREFLIGHT_RATE_MARGIN > preflight.write_rate)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Storage margin low: %.2f MB/s needed at %.0f Hz, %.2f MB/s measured\n", 
+			preflight.required_rate, preflight.prf, preflight.write_rate);
+		
+		if (preflight.result == PREFLIGHT_PASS)
+			preflight.result = PREFLIGHT_WARN;
+	}
+	
+	if (preflight.result == PREFLIGHT_PASS)
+	{
+		cprint("[OK] ", BRIGHT, GREEN);
+		printf("Storage: %.2f MB/s of %.2f MB/s, %.0f MB of %.0f MB free\n", 
+			preflight.required_rate, preflight.write_rate, preflight.required_space, preflight.free_space);
+	}
+	
+	return (preflight.result != PREFLIGHT_FAIL);
+}
+
+
+const Preflight* getPreflight(void)
+{
+	return &preflight;
+}
+
+
+void writePreflightSummary(FILE* summaryFile)
+{
+	const char* results[] = {"pass", "warn", "fail"};
+	
+	fprintf(summaryFile, "\n[preflight]\r\n");
+	fprintf(summaryFile, "result = %s\r\n", results[preflight.result]);
+	fprintf(summaryFile, "free_space = %.1f\r\n", preflight.free_space);
+	fprintf(summaryFile, "required_space = %.1f\r\n", preflight.required_space);
+	fprintf(summaryFile, "write_rate = %.2f\r\n", preflight.write_rate);
+	fprintf(summaryFile, "required_rate = %.2f\r\n", preflight.required_rate);
+	fprintf(summaryFile, "prf = %.1f\r\n", preflight.prf);
+	fprintf(summaryFile, "block_size = %u\r\n", preflight.block_size);
+}
@@ -0,0 +1,42 @@
+#ifndef PREFLIGHT_H
+#define PREFLIGHT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/statvfs.h>
+
+#include "controller.h"
+#include "capture.h"
+#include "calibrate.h"
+#include "plan.h"
+#include "colour.h"
+
+#define PREFLIGHT_BYTES			(16 << 20)	//written by the storage benchmark
+#define PREFLIGHT_TIMEOUT		2.0			//benchmark stops early after [s]
+#define PREFLIGHT_RATE_MARGIN	1.5			//warn below this multiple of the required write rate
+#define PREFLIGHT_SPACE_MARGIN	1.05		//free space needed per MB of recording
+
+#define PREFLIGHT_PASS			0
+#define PREFLIGHT_WARN			1
+#define PREFLIGHT_FAIL			2
+
+typedef struct
+{
+	double free_space;						//free space of the storage directory [MB]
+	double required_space;					//recording size including metadata [MB]
+	double write_rate;						//measured sustained write rate [MB/s], 0 if not measured
+	double required_rate;					//rate the ramp configuration produces [MB/s], 0 if unknown
+	double prf;								//trigger rate the required rate is based on [Hz]
+	uint32_t block_size;					//chunk size written by the writer [bytes]
+	int result;								//PREFLIGHT_*
+} Preflight;
+
+int  runPreflight(Experiment *experiment, Synthesizer *synth);
+const Preflight* getPreflight(void);
+void writePreflightSummary(FILE* summaryFile);
+
+#endif
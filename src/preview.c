@@ -0,0 +1,117 @@
+#include "preview.h"
+#include "colour.h"
+#include "quality.h"
+
+static PreviewRing* ring = NULL;
+static uint32_t every = 0;
+static uint32_t n_seen = 0;
+
+
+//map the ring on the first collection, it stays mapped for later ones.
+//every is the preview decimation, 0 disables the preview.
+int initPreview(uint32_t preview_every, double sample_rate, const char* timestamp)
+{
+	every = preview_every;
+	n_seen = 0;
+	
+	if (!every)
+		return 1;
+	
+	if (!ring)
+	{
+		int fd = shm_open(PREVIEW_NAME, O_CREAT | O_RDWR, 0644);
+		
+		if (fd < 0 || ftruncate(fd, sizeof(PreviewRing)))
+		{
+			if (fd >= 0) close(fd);
+			cprint("[!!] ", BRIGHT, RED);
+			printf("Could not create preview ring %s.\n", PREVIEW_NAME);
+			every = 0;
+			return 0;
+		}
+		
+		void* base = mmap(NULL, sizeof(PreviewRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		
+		if (base == MAP_FAILED)
+		{
+			cprint("[!!] ", BRIGHT, RED);
+			printf("Could not map preview ring %s.\n", PREVIEW_NAME);
+			every = 0;
+			return 0;
+		}
+		
+		ring = (PreviewRing*)base;
+	}
+	
+	//readers resynchronise when the generation changes
+	__atomic_store_n(&ring->is_active, 0, __ATOMIC_RELEASE);
+	
+	ring->magic = PREVIEW_MAGIC;
+	ring->version = PREVIEW_VERSION;
+	ring->size = sizeof(PreviewRing);
+	ring->n_slots = PREVIEW_SLOTS;
+	ring->every = every;
+	ring->sample_rate = sample_rate;
+	strncpy(ring->timestamp, timestamp ? timestamp : "", sizeof(ring->timestamp) - 1);
+	memset(&ring->stats, 0, sizeof(PreviewStats));
+	__atomic_store_n(&ring->n_published, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->generation, ring->generation + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->is_active, 1, __ATOMIC_RELEASE);
+	
+	return 1;
+}
+
+
+//called by the writer thread for every stored ramp, only plain stores into the mapping
+void publishPreview(const int16_t* samples, uint32_t n_samples, const RampMeta* meta)
+{
+	if (!every || (n_seen++ % every))
+		return;
+	
+	uint64_t k = ring->n_published;
+	PreviewFrame* frame = &ring->frames[k % PREVIEW_SLOTS];
+	uint32_t sequence = frame->sequence | 1;
+	
+	if (n_samples > PREVIEW_MAX_SAMPLES)
+		n_samples = PREVIEW_MAX_SAMPLES;
+	
+	__atomic_store_n(&frame->sequence, sequence, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	frame->frame = k;
+	frame->n_samples = n_samples;
+	frame->meta = *meta;
+	memcpy(frame->samples, samples, n_samples*sizeof(int16_t));
+	
+	__atomic_store_n(&frame->sequence, sequence + 1, __ATOMIC_RELEASE);
+	
+	//running stats follow the published frames
+	const QualitySummary* quality = getQuality();
+	double n = quality->n_ramps ? quality->n_ramps : 1;
+	
+	__atomic_store_n(&ring->stats_sequence, ring->stats_sequence | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	ring->stats.n_ramps = quality->n_ramps;
+	ring->stats.n_clipped = quality->n_clipped;
+	ring->stats.n_dead = quality->n_dead;
+	ring->stats.last_ramp = meta->ramp;
+	ring->stats.min = quality->min;
+	ring->stats.max = quality->max;
+	ring->stats.dc_mean = quality->dc_sum/n;
+	ring->stats.rms_mean = quality->rms_sum/n;
+	ring->stats.hf_ratio_mean = quality->hf_ratio_sum/n;
+	
+	__atomic_store_n(&ring->stats_sequence, ring->stats_sequence + 1, __ATOMIC_RELEASE);
+	
+	__atomic_store_n(&ring->n_published, k + 1, __ATOMIC_RELEASE);
+}
+
+
+//mark the end of the collection, the ring stays mapped for the next one
+void closePreview(void)
+{
+	if (ring && every)
+		__atomic_store_n(&ring->is_active, 0, __ATOMIC_RELEASE);
+}
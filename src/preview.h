@@ -0,0 +1,73 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+//live preview ring in posix shared memory
+//
+//the writer thread copies every nth ramp into the next of PREVIEW_SLOTS frames
+//and then advances n_published, frame k lives in slot k % PREVIEW_SLOTS. each
+//frame and the running stats carry a seqlock: the sequence is odd while they
+//are written, so a reader copies them, checks that the sequence is even and
+//unchanged, and otherwise counts the frame as dropped. the writer never waits
+//for a reader.
+
+#define PREVIEW_NAME			"/rpc_preview"
+#define PREVIEW_MAGIC			0x57565250	//"PRVW"
+#define PREVIEW_VERSION			1
+#define PREVIEW_SLOTS			16
+#define PREVIEW_MAX_SAMPLES		16384		//samples per frame, longer ramps are truncated
+
+typedef struct
+{
+	uint32_t n_ramps;						//ramps measured
+	uint32_t n_clipped;
+	uint32_t n_dead;
+	uint32_t last_ramp;						//along-track index of the last ramp
+	int16_t min;
+	int16_t max;
+	uint32_t reserved;
+	double dc_mean;
+	double rms_mean;
+	double hf_ratio_mean;
+} PreviewStats;
+
+typedef struct
+{
+	uint32_t sequence;						//odd while the frame is written
+	uint32_t n_samples;
+	uint64_t frame;							//publication number of this frame
+	RampMeta meta;
+	int16_t samples[PREVIEW_MAX_SAMPLES];
+} PreviewFrame;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;							//sizeof(PreviewRing)
+	uint32_t n_slots;
+	uint32_t is_active;						//1 while a collection is publishing
+	uint32_t generation;					//incremented for every collection
+	uint32_t every;							//one ramp in every published
+	uint32_t stats_sequence;				//odd while stats are written
+	uint64_t n_published;					//frames published in this generation
+	double sample_rate;						//[Hz]
+	char timestamp[24];						//experiment folder time stamp
+	PreviewStats stats;
+	PreviewFrame frames[PREVIEW_SLOTS];
+} PreviewRing;
+
+int  initPreview(uint32_t every, double sample_rate, const char* timestamp);
+void publishPreview(const int16_t* samples, uint32_t n_samples, const RampMeta* meta);
+void closePreview(void);
+
+#endif
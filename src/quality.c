@@ -0,0 +1,182 @@
+#include "quality.h"
+
+//per-ramp signal quality, measured on the writer thread before a ramp is stored.
+//rms is taken about the dc offset. hf_ratio compares the energy of the first
+//difference with that of the signal: about 1 for white noise, near 0 for the
+//low beat frequencies of a target scene, so a ramp of pure noise stands out.
+
+static QualitySummary quality;
+
+
+void computeRampStats(const int16_t* samples, uint32_t n_samples, RampStats* stats)
+{
+	int64_t sum = 0;
+	int64_t sum_squares = 0;
+	int64_t diff_squares = 0;
+	uint32_t n_clipped = 0;
+	int16_t min = INT16_MAX;
+	int16_t max = INT16_MIN;
+	uint32_t i = 0;
+	
+	memset(stats, 0, sizeof(RampStats));
+	
+	if (n_samples == 0)
+		return;
+	
+#ifdef __ARM_NEON
+	int16x8_t v_min = vdupq_n_s16(INT16_MAX);
+	int16x8_t v_max = vdupq_n_s16(INT16_MIN);
+	int32x4_t v_sum = vdupq_n_s32(0);
+	int64x2_t v_squares = vdupq_n_s64(0);
+	int64x2_t v_diffs = vdupq_n_s64(0);
+	uint32x4_t v_clipped = vdupq_n_u32(0);
+	const int16x8_t rail_high = vdupq_n_s16(QUALITY_RAIL_HIGH);
+	const int16x8_t rail_low = vdupq_n_s16(QUALITY_RAIL_LOW);
+	
+	//eight samples and the eight differences to their successors per iteration
+	for (; i + 9 <= n_samples; i += 8)
+	{
+		int16x8_t x = vld1q_s16(&samples[i]);
+		int16x8_t d = vsubq_s16(vld1q_s16(&samples[i + 1]), x);
+		
+		v_min = vminq_s16(v_min, x);
+		v_max = vmaxq_s16(v_max, x);
+		v_sum = vpadalq_s16(v_sum, x);
+		
+		//two 14-bit squares fit a 32-bit lane before widening
+		int32x4_t squares = vmlal_s16(vmull_s16(vget_low_s16(x), vget_low_s16(x)), vget_high_s16(x), vget_high_s16(x));
+		int32x4_t diffs = vmlal_s16(vmull_s16(vget_low_s16(d), vget_low_s16(d)), vget_high_s16(d), vget_high_s16(d));
+		v_squares = vpadalq_s32(v_squares, squares);
+		v_diffs = vpadalq_s32(v_diffs, diffs);
+		
+		//comparison lanes are all ones, shifted down to count 1 per clipped sample
+		uint16x8_t clipped = vorrq_u16(vcgeq_s16(x, rail_high), vcleq_s16(x, rail_low));
+		v_clipped = vpadalq_u16(v_clipped, vshrq_n_u16(clipped, 15));
+	}
+	
+	//horizontal reductions with pairwise operations, available on armv7
+	int16x4_t h_min = vpmin_s16(vget_low_s16(v_min), vget_high_s16(v_min));
+	int16x4_t h_max = vpmax_s16(vget_low_s16(v_max), vget_high_s16(v_max));
+	h_min = vpmin_s16(h_min, h_min);
+	h_max = vpmax_s16(h_max, h_max);
+	h_min = vpmin_s16(h_min, h_min);
+	h_max = vpmax_s16(h_max, h_max);
+	min = vget_lane_s16(h_min, 0);
+	max = vget_lane_s16(h_max, 0);
+	
+	int64x2_t sum64 = vpaddlq_s32(v_sum);
+	uint64x2_t clipped64 = vpaddlq_u32(v_clipped);
+	sum = vgetq_lane_s64(sum64, 0) + vgetq_lane_s64(sum64, 1);
+	sum_squares = vgetq_lane_s64(v_squares, 0) + vgetq_lane_s64(v_squares, 1);
+	diff_squares = vgetq_lane_s64(v_diffs, 0) + vgetq_lane_s64(v_diffs, 1);
+	n_clipped = vgetq_lane_u64(clipped64, 0) + vgetq_lane_u64(clipped64, 1);
+#endif
+	
+	for (; i < n_samples; i++)
+	{
+		int32_t x = samples[i];
+		
+		if (x < min) min = x;
+		if (x > max) max = x;
+		if (x >= QUALITY_RAIL_HIGH || x <= QUALITY_RAIL_LOW) n_clipped++;
+		
+		sum += x;
+		sum_squares += x*x;
+		
+		if (i + 1 < n_samples)
+		{
+			int32_t d = samples[i + 1] - x;
+			diff_squares += d*d;
+		}
+	}
+	
+	double dc = (double)sum/n_samples;
+	double variance = (double)sum_squares/n_samples - dc*dc;
+	
+	stats->min = min;
+	stats->max = max;
+	stats->n_clipped = (n_clipped > UINT16_MAX) ? UINT16_MAX : n_clipped;
+	stats->dc = dc;
+	stats->rms = (variance > 0) ? sqrt(variance) : 0;
+	stats->hf_ratio = (variance > 0 && n_samples > 1) ? diff_squares/(2.0*(n_samples - 1)*variance) : 0;
+}
+
+
+void initQuality(void)
+{
+	memset(&quality, 0, sizeof(QualitySummary));
+	quality.min = INT16_MAX;
+	quality.max = INT16_MIN;
+	quality.rms_min = INFINITY;
+	quality.t_clip_warning = -INFINITY;
+	quality.t_dead_warning = -INFINITY;
+}
+
+
+//fill meta->stats, flag clipped and dead ramps and warn at most once per interval
+void measureRamp(const int16_t* samples, uint32_t n_samples, RampMeta* meta)
+{
+	RampStats* stats = &meta->stats;
+	
+	computeRampStats(samples, n_samples, stats);
+	
+	quality.n_ramps++;
+	quality.dc_sum += stats->dc;
+	quality.rms_sum += stats->rms;
+	quality.hf_ratio_sum += stats->hf_ratio;
+	
+	if (stats->min < quality.min) quality.min = stats->min;
+	if (stats->max > quality.max) quality.max = stats->max;
+	if (stats->rms < quality.rms_min) quality.rms_min = stats->rms;
+	if (stats->rms > quality.rms_max) quality.rms_max = stats->rms;
+	
+	if (stats->n_clipped)
+	{
+		meta->flags |= RAMP_CLIPPED;
+		quality.n_clipped++;
+		quality.clipped_samples += stats->n_clipped;
+		
+		if (meta->t - quality.t_clip_warning >= QUALITY_WARN_INTERVAL)
+		{
+			quality.t_clip_warning = meta->t;
+			logEvent(LOG_WARN, "Ramp %u clipped: %u samples on the rails\n", meta->ramp, stats->n_clipped);
+		}
+	}
+	
+	if (stats->rms < QUALITY_DEAD_RMS)
+	{
+		meta->flags |= RAMP_DEAD;
+		quality.n_dead++;
+		
+		if (meta->t - quality.t_dead_warning >= QUALITY_WARN_INTERVAL)
+		{
+			quality.t_dead_warning = meta->t;
+			logEvent(LOG_WARN, "Ramp %u has no signal: rms %.2f, dc %.1f\n", meta->ramp, (double)stats->rms, (double)stats->dc);
+		}
+	}
+}
+
+
+const QualitySummary* getQuality(void)
+{
+	return &quality;
+}
+
+
+void writeQualitySummary(FILE* summaryFile)
+{
+	double n = quality.n_ramps ? quality.n_ramps : 1;
+	
+	fprintf(summaryFile, "\n[quality]\r\n");
+	fprintf(summaryFile, "measured_ramps = %u\r\n", quality.n_ramps);
+	fprintf(summaryFile, "clipped_ramps = %u\r\n", quality.n_clipped);
+	fprintf(summaryFile, "clipped_samples = %llu\r\n", (unsigned long long)quality.clipped_samples);
+	fprintf(summaryFile, "dead_ramps = %u\r\n", quality.n_dead);
+	fprintf(summaryFile, "sample_min = %i\r\n", quality.n_ramps ? quality.min : 0);
+	fprintf(summaryFile, "sample_max = %i\r\n", quality.n_ramps ? quality.max : 0);
+	fprintf(summaryFile, "dc_mean = %.2f\r\n", quality.dc_sum/n);
+	fprintf(summaryFile, "rms_mean = %.2f\r\n", quality.rms_sum/n);
+	fprintf(summaryFile, "rms_min = %.2f\r\n", quality.n_ramps ? quality.rms_min : 0);
+	fprintf(summaryFile, "rms_max = %.2f\r\n", quality.rms_max);
+	fprintf(summaryFile, "hf_ratio_mean = %.3f\r\n", quality.hf_ratio_sum/n);
+}
@@ -0,0 +1,43 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+#include "capture.h"
+#include "logger.h"
+
+#define QUALITY_RAIL_HIGH		8191		//14-bit adc rails, samples at or beyond count as clipped
+#define QUALITY_RAIL_LOW		-8192
+#define QUALITY_DEAD_RMS		2.0			//ramps with less ac rms [adc counts] are flagged dead
+#define QUALITY_WARN_INTERVAL	1.0			//minimum time between live warnings of one kind [s]
+
+typedef struct
+{
+	uint32_t n_ramps;						//ramps measured, placeholders excluded
+	uint32_t n_clipped;						//ramps with at least one sample on a rail
+	uint32_t n_dead;						//ramps below QUALITY_DEAD_RMS
+	uint64_t clipped_samples;
+	int16_t min;
+	int16_t max;
+	double dc_sum;
+	double rms_sum;
+	double rms_min;
+	double rms_max;
+	double hf_ratio_sum;
+	double t_clip_warning;					//trigger time of the last live warning [s]
+	double t_dead_warning;
+} QualitySummary;
+
+void computeRampStats(const int16_t* samples, uint32_t n_samples, RampStats* stats);
+void initQuality(void);
+void measureRamp(const int16_t* samples, uint32_t n_samples, RampMeta* meta);
+const QualitySummary* getQuality(void);
+void writeQualitySummary(FILE* summaryFile);
+
+#endif
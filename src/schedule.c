@@ -0,0 +1,59 @@
+#include "schedule.h"
+
+
+static int scheduleHandler(void* pointer, const char* section, const char* attribute, const char* value)
+{
+	Schedule* schedule = (Schedule*)pointer;
+	int n;
+	
+	if (sscanf(section, "burst%d", &n) != 1 || n < 0 || n >= SCHEDULE_MAX_BURSTS)
+		return 1;
+	
+	Burst* burst = &schedule->bursts[n];
+	
+	if (n >= schedule->n_bursts)
+		schedule->n_bursts = n + 1;
+	
+	if (!strcmp(attribute, "ramps"))			burst->n_ramps = atoi(value);
+	else if (!strcmp(attribute, "lo"))			snprintf(burst->lo, SCHEDULE_NAME_SIZE, "%s", value);
+	else if (!strcmp(attribute, "rf"))			snprintf(burst->rf, SCHEDULE_NAME_SIZE, "%s", value);
+	else if (!strcmp(attribute, "gap"))			burst->gap = atof(value);
+	else if (!strcmp(attribute, "comment"))		snprintf(burst->comment, SCHEDULE_COMMENT_SIZE, "%s", value);
+	
+	return 1;
+}
+
+
+//read the bursts of a schedule file, ramp files left out are carried over from
+//the previous burst and lo/rf for the first one. returns the number of bursts.
+int loadSchedule(const char* filename, Schedule* schedule, const char* lo, const char* rf)
+{
+	memset(schedule, 0, sizeof(Schedule));
+	
+	if (ini_parse(filename, scheduleHandler, schedule) < 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open schedule %s.\n", filename);
+		return 0;
+	}
+	
+	for (int i = 0; i < schedule->n_bursts; i++)
+	{
+		Burst* burst = &schedule->bursts[i];
+		
+		if (!burst->lo[0])
+			snprintf(burst->lo, SCHEDULE_NAME_SIZE, "%s", i ? schedule->bursts[i - 1].lo : lo);
+		
+		if (!burst->rf[0])
+			snprintf(burst->rf, SCHEDULE_NAME_SIZE, "%s", i ? schedule->bursts[i - 1].rf : rf);
+		
+		if (burst->n_ramps <= 0)
+		{
+			cprint("[!!] ", BRIGHT, RED);
+			printf("Burst %i has no ramps.\n", i);
+			return 0;
+		}
+	}
+	
+	return schedule->n_bursts;
+}
@@ -0,0 +1,40 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ini.h"
+#include "colour.h"
+
+#define SCHEDULE_MAX_BURSTS		64
+#define SCHEDULE_NAME_SIZE		50
+#define SCHEDULE_COMMENT_SIZE	140
+
+//a schedule file lists bursts that are recorded back to back:
+//  [burst0]
+//  ramps = 20000			; ramps to record
+//  lo = tri.ini			; ramp files, default to those of the previous burst
+//  rf = tri_fn.ini
+//  gap = 2.5				; idle time after the burst [s]
+//  comment = runway pass 1
+
+typedef struct
+{
+	int n_ramps;
+	char lo[SCHEDULE_NAME_SIZE];
+	char rf[SCHEDULE_NAME_SIZE];
+	double gap;
+	char comment[SCHEDULE_COMMENT_SIZE];
+} Burst;
+
+typedef struct
+{
+	int n_bursts;
+	Burst bursts[SCHEDULE_MAX_BURSTS];
+} Schedule;
+
+int loadSchedule(const char* filename, Schedule* schedule, const char* lo, const char* rf);
+
+#endif
@@ -0,0 +1,475 @@
+#ifdef RP_SIM
+
+#include "sim.h"
+
+//fault schedule and expectations read from $RPC_FAULTS
+static Fault faults[SIM_MAX_FAULTS];
+static int n_faults = 0;
+static Expect expects[SIM_CHECKS];
+static const char* faults_filename = NULL;
+
+static const char* fault_names[FAULT_TYPES] = {"transfer_delay", "missed_trigger", "double_trigger", "write_stall", "imu_corrupt", "late_trigger"};
+static const char* check_names[SIM_CHECKS] = {"n_flags", "n_missed", "n_corrupt", "dropped", "stored", "placeholders", "duplicates", "misindexed", "torn", "bad_chunks", "skipped"};
+
+static double prf = SIM_PRF;
+static double transfer_fixed = SIM_TRANSFER_FIXED;
+static double transfer_per_sample = SIM_TRANSFER_PER_SAMPLE;
+
+//trigger state, edges are numbered from the synth trigger pulse
+static rp_acq_trig_src_t trigger_source = RP_TRIG_SRC_DISABLED;
+static double t_synth = 0;					//synth trigger pulse [s], 0 before the first pulse
+static double t_arm = 0;					//trigger source last armed [s]
+static double t_edge = 0;					//last edge captured [s]
+static double t_seen = 0;					//time the capture loop saw it [s]
+static double t_sim = 0;					//capture loop time on the simulated timeline, 0 before the first edge [s]
+static int64_t edge = -1;					//trigger the adc buffer holds
+static int64_t n_now = 0;					//software triggers
+static int is_edge = 0;						//buffer was captured on a trigger edge
+
+//faults applied, counted by the thread that applies them
+static int64_t n_injected[FAULT_TYPES];
+static int64_t n_uart_reads = 0;
+
+
+static int faultHandler(void* pointer, const char* section, const char* attribute, const char* value)
+{
+	int n;
+	
+	if (!strcmp(section, "sim"))
+	{
+		if (!strcmp(attribute, "prf"))							prf = atof(value);
+		else if (!strcmp(attribute, "transfer_fixed"))			transfer_fixed = atof(value);
+		else if (!strcmp(attribute, "transfer_per_sample"))		transfer_per_sample = atof(value);
+	}
+	else if (!strcmp(section, "expect"))
+	{
+		for (int i = 0; i < SIM_CHECKS; i++)
+		{
+			if (strcmp(attribute, check_names[i]))
+				continue;
+			
+			long long min, max;
+			int n_values = sscanf(value, "%lld %lld", &min, &max);
+			
+			expects[i].is_set = (n_values > 0);
+			expects[i].min = min;
+			expects[i].max = (n_values == 2) ? max : min;
+		}
+	}
+	else if (sscanf(section, "fault%d", &n) == 1 && n >= 0 && n < SIM_MAX_FAULTS)
+	{
+		Fault* fault = &faults[n];
+		
+		if (n >= n_faults)
+			n_faults = n + 1;
+		
+		if (!strcmp(attribute, "type"))
+		{
+			for (int i = 0; i < FAULT_TYPES; i++)
+				if (!strcmp(value, fault_names[i]))
+					fault->type = i;
+		}
+		else if (!strcmp(attribute, "at"))				fault->at = atoll(value);
+		else if (!strcmp(attribute, "count"))			fault->count = atoll(value);
+		else if (!strcmp(attribute, "duration"))		fault->duration = atof(value);
+		else if (!strcmp(attribute, "bytes"))			fault->bytes = atoi(value);
+	}
+	
+	return 1;
+}
+
+
+//a fault covers one trigger or read unless a count is given
+static inline int64_t faultCount(const Fault* fault)
+{
+	return fault->count ? fault->count : 1;
+}
+
+
+//returns the fault of the given type covering trigger or read n, NULL if there is none
+static const Fault* findFault(int type, int64_t n)
+{
+	for (int i = 0; i < n_faults; i++)
+		if (faults[i].type == type && n >= faults[i].at && n < faults[i].at + faultCount(&faults[i]))
+			return &faults[i];
+	
+	return NULL;
+}
+
+
+//adc pattern that identifies the trigger a ramp was captured on
+static inline int16_t simSample(int64_t id, uint32_t i)
+{
+	if (i == 0) return id & 0x1fff;
+	if (i == 1) return (id >> 13) & 0x1fff;
+	
+	return ((id*7 + i) & 0x0fff) - 2048;
+}
+
+
+//first trigger edge at or after t, skipping missed triggers and adding spurious ones
+static double nextEdge(double t, int64_t* id)
+{
+	double period = 1/prf;
+	int64_t k = ceil((t - t_synth)/period);
+	
+	if (k < 0)
+		k = 0;
+	
+	while (findFault(FAULT_MISSED_TRIGGER, k))
+		k++;
+	
+	*id = k;
+	double t_next = t_synth + k*period;
+	
+	//a double trigger fires again shortly after its trigger
+	for (int64_t j = k - 1; j <= k; j++)
+	{
+		double t_double = t_synth + (j + SIM_DOUBLE_OFFSET)*period;
+		
+		if (j >= 0 && t_double >= t && t_double < t_next && findFault(FAULT_DOUBLE_TRIGGER, j))
+		{
+			*id = j;
+			t_next = t_double;
+		}
+	}
+	
+	return t_next;
+}
+
+
+static void spinUntil(double t)
+{
+	while (monotonicTime() < t);
+}
+
+
+int rp_Init()
+{
+	faults_filename = getenv("RPC_FAULTS");
+	
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("Simulated red pitaya");
+	
+	if (faults_filename)
+	{
+		if (ini_parse(faults_filename, faultHandler, NULL) < 0)
+		{
+			printf("\n");
+			cprint("[!!] ", BRIGHT, RED);
+			printf("Could not open fault schedule %s.\n", faults_filename);
+			return RP_EOED;
+		}
+		
+		printf(", %i faults from %s", n_faults, faults_filename);
+	}
+	
+	printf(" (%.0f Hz).\n", prf);
+	
+	return RP_OK;
+}
+
+
+int rp_Release()
+{
+	return RP_OK;
+}
+
+
+//the synths start ramping on the rising edge of their trigger pins
+int setpins(int pin1, int val1, int pin2, int val2, int baseadd)
+{
+	if (val1 || val2)
+	{
+		t_synth = monotonicTime();
+		t_edge = 0;
+		t_sim = 0;
+		edge = -1;
+		memset(n_injected, 0, sizeof(n_injected));
+	}
+	
+	return 0;
+}
+
+
+int rp_DpinSetDirection(rp_dpin_t pin, rp_pinDirection_t direction)	{ return RP_OK; }
+int rp_DpinSetState(rp_dpin_t pin, rp_pinState_t state)				{ return RP_OK; }
+int rp_GenReset()													{ return RP_OK; }
+int rp_GenOutEnable(rp_channel_t channel)							{ return RP_OK; }
+int rp_GenOutDisable(rp_channel_t channel)							{ return RP_OK; }
+int rp_GenAmp(rp_channel_t channel, float amplitude)				{ return RP_OK; }
+int rp_GenFreq(rp_channel_t channel, float frequency)				{ return RP_OK; }
+int rp_GenWaveform(rp_channel_t channel, rp_waveform_t type)		{ return RP_OK; }
+int rp_GenMode(rp_channel_t channel, rp_gen_mode_t mode)			{ return RP_OK; }
+int rp_AcqSetDecimation(rp_acq_decimation_t decimation)				{ return RP_OK; }
+int rp_AcqSetAveraging(bool enabled)								{ return RP_OK; }
+int rp_AcqSetTriggerDelay(int32_t decimated_data_num)				{ return RP_OK; }
+int rp_AcqStart()													{ return RP_OK; }
+
+
+int rp_AcqGetAveraging(bool *enabled)
+{
+	*enabled = false;
+	return RP_OK;
+}
+
+
+//once ramps are captured the trigger is armed on the simulated timeline, so
+//preemption of the host delays the run but never changes which edges are seen
+int rp_AcqSetTriggerSrc(rp_acq_trig_src_t source)
+{
+	trigger_source = source;
+	t_arm = (t_sim > 0) ? t_sim : monotonicTime();
+	
+	return RP_OK;
+}
+
+
+//the trigger source falls back to disabled once the adc has triggered
+int rp_AcqGetTriggerSrc(rp_acq_trig_src_t* source)
+{
+	if (trigger_source == RP_TRIG_SRC_NOW)
+	{
+		edge = n_now++;
+		is_edge = 0;
+		trigger_source = RP_TRIG_SRC_DISABLED;
+	}
+	else if (trigger_source != RP_TRIG_SRC_DISABLED && t_synth > 0)
+	{
+		int64_t id;
+		
+		//an edge is seen once, and only while the trigger is armed
+		double t = nextEdge((t_edge >= t_arm) ? t_edge + 1e-9 : t_arm, &id);
+		
+		//a late trigger is seen after its edge, as if the loop was held up
+		const Fault* fault = findFault(FAULT_LATE_TRIGGER, id);
+		double t_late = t + (fault ? fault->duration*1e-6 : 0);
+		
+		if (monotonicTime() >= t_late)
+		{
+			if (fault)
+				n_injected[FAULT_LATE_TRIGGER]++;
+			
+			edge = id;
+			is_edge = 1;
+			t_edge = t;
+			t_seen = t_sim = t_late;
+			trigger_source = RP_TRIG_SRC_DISABLED;
+		}
+	}
+	
+	*source = trigger_source;
+	
+	return RP_OK;
+}
+
+
+//transfer time follows the calibrated model of the real board, plus injected delays
+int rp_AcqGetLatestDataRaw(rp_channel_t channel, uint32_t* size, int16_t* buffer)
+{
+	double t_start = monotonicTime();
+	double duration = transfer_fixed + transfer_per_sample*(*size);
+	
+	const Fault* fault = is_edge ? findFault(FAULT_TRANSFER_DELAY, edge) : NULL;
+	
+	if (fault)
+	{
+		duration += fault->duration;
+		n_injected[FAULT_TRANSFER_DELAY]++;
+	}
+	
+	for (uint32_t i = 0; i < *size; i++)
+		buffer[i] = simSample(edge, i);
+	
+	if (is_edge)
+		t_sim += duration*1e-6;
+	
+	spinUntil(t_start + duration*1e-6);
+	
+	return RP_OK;
+}
+
+
+//the capture loop's trigger time, taken on the simulated timeline
+double simTriggerTime(double t)
+{
+	return is_edge ? t_seen : t;
+}
+
+
+//called by the writer before it stores a ramp
+void simStall(uint32_t ramp)
+{
+	const Fault* fault = findFault(FAULT_WRITE_STALL, ramp);
+	
+	if (fault)
+	{
+		n_injected[FAULT_WRITE_STALL]++;
+		usleep(fault->duration);
+	}
+}
+
+
+//called with each uart read, flips bytes of the reads the schedule covers
+void simCorrupt(uint8_t* buffer, int n)
+{
+	const Fault* fault = findFault(FAULT_IMU_CORRUPT, n_uart_reads++);
+	
+	if (!fault || n <= 0)
+		return;
+	
+	n_injected[FAULT_IMU_CORRUPT]++;
+	
+	for (int i = 0; i < (fault->bytes ? fault->bytes : 1); i++)
+		buffer[(n_uart_reads*31 + i*17) % n] ^= 0xff;
+}
+
+
+//triggers of a fault that went by before the last captured edge
+static int64_t countPassed(int type)
+{
+	int64_t n = 0;
+	
+	for (int i = 0; i < n_faults; i++)
+	{
+		if (faults[i].type != type)
+			continue;
+		
+		int64_t passed = edge + 1 - faults[i].at;
+		n += (passed < 0) ? 0 : (passed > faultCount(&faults[i])) ? faultCount(&faults[i]) : passed;
+	}
+	
+	return n;
+}
+
+
+//checks the capture files against the run counters and the expectations, returns 0 if any failed
+int checkFaults(Experiment *experiment)
+{
+	int64_t values[SIM_CHECKS];
+	char filename[WRITER_FILENAME_SIZE];
+	char previous[WRITER_FILENAME_SIZE] = "";
+	CaptureMap map;
+	
+	memset(values, 0, sizeof(values));
+	values[0] = experiment->n_flags;
+	values[1] = experiment->n_missed;
+	values[2] = experiment->n_corrupt;
+	values[3] = getWriterDropped();
+	
+	int16_t* samples = (int16_t*)malloc(ADC_BUFFER_SIZE*sizeof(int16_t));
+	int64_t last_id = -1, first_id = -1;
+	uint32_t first_ramp = 0;
+	
+	for (int segment = 0; samples && segment < WRITER_MAX_SEGMENTS; segment++)
+	{
+		segmentName(filename, experiment->ch1_filename, segment);
+		
+		if (!strcmp(filename, previous) || !mapCapture(&map, filename))
+			break;
+		
+		strcpy(previous, filename);
+		
+		for (uint32_t i = 0; i < map.n_chunks; i++)
+			values[9] += !checkCaptureChunk(&map, i);
+		
+		for (uint32_t i = 0; i < map.n_ramps; i++)
+		{
+			RampMeta* meta;
+			
+			if (!readCaptureRamp(&map, i, samples, &meta))
+			{
+				values[8]++;
+				continue;
+			}
+			
+			values[4]++;
+			
+			if (meta->flags & RAMP_PLACEHOLDER)
+			{
+				values[5]++;
+				continue;
+			}
+			
+			int64_t id = (samples[0] & 0x1fff) | ((int64_t)(samples[1] & 0x1fff) << 13);
+			
+			for (uint32_t j = 2; j < map.header->ns_ramp; j++)
+			{
+				if (samples[j] != simSample(id, j))
+				{
+					values[8]++;
+					break;
+				}
+			}
+			
+			if (first_id < 0)
+			{
+				first_id = id;
+				first_ramp = meta->ramp;
+			}
+			
+			values[6] += (id == last_id);
+			values[10] += (last_id >= 0 && id > last_id) ? id - last_id - 1 : 0;
+			values[7] += (meta->ramp - first_ramp != id - first_id);
+			last_id = id;
+		}
+		
+		unmapCapture(&map);
+	}
+	
+	free(samples);
+	
+	n_injected[FAULT_MISSED_TRIGGER] = countPassed(FAULT_MISSED_TRIGGER);
+	n_injected[FAULT_DOUBLE_TRIGGER] = countPassed(FAULT_DOUBLE_TRIGGER);
+	
+	int is_passed = 1;
+	
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("Injected:");
+	
+	for (int i = 0; i < FAULT_TYPES; i++)
+		printf(" %s %lld", fault_names[i], (long long)n_injected[i]);
+	
+	printf("\n");
+	
+	for (int i = 0; i < SIM_CHECKS; i++)
+	{
+		if (!expects[i].is_set)
+			continue;
+		
+		int is_met = (values[i] >= expects[i].min) && (values[i] <= expects[i].max);
+		
+		if (is_met)
+			cprint("[OK] ", BRIGHT, GREEN);
+		else
+			cprint("[!!] ", BRIGHT, RED);
+		
+		if (expects[i].min == expects[i].max)
+			printf("%s = %lld, expected %lld\n", check_names[i], (long long)values[i], (long long)expects[i].min);
+		else
+			printf("%s = %lld, expected %lld to %lld\n", check_names[i], (long long)values[i], (long long)expects[i].min, (long long)expects[i].max);
+		
+		is_passed &= is_met;
+	}
+	
+	FILE* summaryFile = appendSummary(experiment);
+	
+	if (summaryFile)
+	{
+		fprintf(summaryFile, "\n[faults]\r\n");
+		fprintf(summaryFile, "schedule = %s\r\n", faults_filename ? faults_filename : "none");
+		fprintf(summaryFile, "result = %s\r\n", is_passed ? "pass" : "fail");
+		
+		for (int i = 0; i < FAULT_TYPES; i++)
+			fprintf(summaryFile, "injected_%s = %lld\r\n", fault_names[i], (long long)n_injected[i]);
+		
+		for (int i = 0; i < SIM_CHECKS; i++)
+			fprintf(summaryFile, "%s = %lld\r\n", check_names[i], (long long)values[i]);
+		
+		fclose(summaryFile);
+	}
+	
+	return is_passed;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "ini.h"
+#include "colour.h"
+
+//simulated red pitaya for bench tests of the acquisition pipeline, built with
+//make sim (-DRP_SIM) in place of librp. triggers arrive at a fixed rate from
+//the synth trigger pulse on, the adc returns a ramp pattern that identifies the
+//trigger it was captured on, and faults are injected on a schedule read from
+//the file in $RPC_FAULTS. the run is paced by the host clock, but the capture
+//loop is stamped and re-armed on a simulated timeline (edge time plus modelled
+//transfer time), so which triggers are captured and the ramp index they get do
+//not depend on host scheduling:
+//  [sim]
+//  prf = 1000				; trigger rate [Hz]
+//  transfer_fixed = 10		; transfer time per call [us]
+//  transfer_per_sample = 0.02	; and per sample [us]
+//
+//  [fault0]
+//  type = transfer_delay	; transfer_delay, missed_trigger, double_trigger, write_stall, imu_corrupt, late_trigger
+//  at = 1000				; first trigger affected (uart read for imu_corrupt)
+//  count = 1				; consecutive triggers or reads affected
+//  duration = 1500			; extra transfer time, writer stall or trigger detection delay [us]
+//  bytes = 4				; bytes flipped per uart read
+//
+//  [expect]
+//  n_missed = 3			; exact value
+//  n_corrupt = 1 5			; or inclusive range
+//
+//expectations are checked against the run counters and the capture file after
+//the collection: n_flags, n_missed, n_corrupt, dropped, stored, placeholders,
+//duplicates (ramps captured twice), misindexed (ramp index that does not follow
+//the trigger), torn (samples from more than one trigger), bad_chunks (crc) and
+//skipped (triggers that really went by, as opposed to n_missed which the capture
+//loop infers from the trigger times).
+
+#define SIM_MAX_FAULTS			64
+#define SIM_PRF					1000.0		//default trigger rate [Hz]
+#define SIM_TRANSFER_FIXED		10.0		//default transfer time per call [us]
+#define SIM_TRANSFER_PER_SAMPLE	0.02		//default transfer time per sample [us]
+#define SIM_DOUBLE_OFFSET		0.3			//spurious edge after the trigger [periods]
+
+#define FAULT_TRANSFER_DELAY	0
+#define FAULT_MISSED_TRIGGER	1
+#define FAULT_DOUBLE_TRIGGER	2
+#define FAULT_WRITE_STALL		3
+#define FAULT_IMU_CORRUPT		4
+#define FAULT_LATE_TRIGGER		5
+#define FAULT_TYPES				6
+
+#define SIM_CHECKS				11
+
+typedef struct
+{
+	int type;								//FAULT_*
+	int64_t at;								//first trigger, or uart read for imu_corrupt
+	int64_t count;							//consecutive triggers or reads
+	double duration;						//[us]
+	int bytes;								//flipped per uart read
+} Fault;
+
+typedef struct
+{
+	int is_set;
+	int64_t min;
+	int64_t max;
+} Expect;
+
+#ifdef RP_SIM
+
+#include "controller.h"
+#include "capture.h"
+#include "writer.h"
+
+void simStall(uint32_t ramp);
+void simCorrupt(uint8_t* buffer, int n);
+double simTriggerTime(double t);
+int  checkFaults(Experiment *experiment);
+
+#else
+
+//no-ops against the real hardware
+#define simStall(ramp)
+#define simCorrupt(buffer, n)
+#define simTriggerTime(t)		(t)
+#define checkFaults(experiment)	1
+
+#endif
+
+#endif
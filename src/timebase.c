@@ -0,0 +1,211 @@
+#include "timebase.h"
+
+//gps fixes as (monotonic receive time, unwrapped gps time) pairs
+static double fix_t[TIMEBASE_WINDOW];
+static double fix_gps[TIMEBASE_WINDOW];
+static int fix_head = 0;
+static int fix_count = 0;
+
+static float last_gps_time = -1;
+static double day_offset = 0;
+static double first_gps = -1;
+
+static Timebase timebase;
+static pthread_mutex_t timebase_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fitTimebase(void);
+
+
+void initTimebase(void)
+{
+	pthread_mutex_lock(&timebase_lock);
+	
+	fix_head = 0;
+	fix_count = 0;
+	last_gps_time = -1;
+	day_offset = 0;
+	first_gps = -1;
+	
+	timebase.n_fixes = 0;
+	timebase.is_locked = 0;
+	timebase.t_ref = 0;
+	timebase.offset = 0;
+	timebase.rate = 1;
+	timebase.residual = 0;
+	
+	pthread_mutex_unlock(&timebase_lock);
+}
+
+
+//convert the um7 hhmmss.ss utc time register into seconds since midnight
+double hmsToSeconds(float hhmmss)
+{
+	int hms = (int)hhmmss;
+	double fraction = hhmmss - hms;
+	
+	return (hms/10000)*3600.0 + ((hms/100) % 100)*60.0 + (hms % 100) + fraction;
+}
+
+
+//called from the imu thread whenever a DREG_GPS_TIME register is received at monotonic time t
+void updateTimebase(float gps_time, double t)
+{
+	//gps time is repeated in every gps broadcast, only a new value marks a new fix
+	if (gps_time == last_gps_time || gps_time < 0)
+		return;
+	
+	last_gps_time = gps_time;
+	
+	double gps = hmsToSeconds(gps_time);
+	
+	pthread_mutex_lock(&timebase_lock);
+	
+	if (first_gps < 0)
+		first_gps = gps;
+	
+	//unwrap midnight
+	if (gps + day_offset < first_gps - SECONDS_PER_DAY/2)
+		day_offset += SECONDS_PER_DAY;
+	
+	fix_t[fix_head] = t;
+	fix_gps[fix_head] = gps + day_offset;
+	fix_head = (fix_head + 1) % TIMEBASE_WINDOW;
+	
+	if (fix_count < TIMEBASE_WINDOW)
+		fix_count++;
+	
+	timebase.n_fixes++;
+	
+	fitTimebase();
+	
+	pthread_mutex_unlock(&timebase_lock);
+}
+
+
+//least squares fit of gps time against monotonic time over the fix window
+static void fitTimebase(void)
+{
+	if (fix_count < TIMEBASE_MIN_FIXES)
+		return;
+	
+	double t_mean = 0;
+	double gps_mean = 0;
+	
+	for (int i = 0; i < fix_count; i++)
+	{
+		t_mean += fix_t[i];
+		gps_mean += fix_gps[i];
+	}
+	
+	t_mean /= fix_count;
+	gps_mean /= fix_count;
+	
+	double s_tt = 0;
+	double s_tg = 0;
+	
+	for (int i = 0; i < fix_count; i++)
+	{
+		s_tt += (fix_t[i] - t_mean)*(fix_t[i] - t_mean);
+		s_tg += (fix_t[i] - t_mean)*(fix_gps[i] - gps_mean);
+	}
+	
+	if (s_tt <= 0)
+		return;
+	
+	double rate = s_tg/s_tt;
+	double sum_sq = 0;
+	
+	for (int i = 0; i < fix_count; i++)
+	{
+		double error = fix_gps[i] - (gps_mean + rate*(fix_t[i] - t_mean));
+		sum_sq += error*error;
+	}
+	
+	timebase.is_locked = 1;
+	timebase.t_ref = t_mean;
+	timebase.offset = gps_mean;
+	timebase.rate = rate;
+	timebase.residual = sqrt(sum_sq/fix_count);
+}
+
+
+//convert a monotonic timestamp to gps time, returns 0 while the fit is not locked
+int gpsTime(double t, double* t_gps)
+{
+	pthread_mutex_lock(&timebase_lock);
+	
+	int is_locked = timebase.is_locked;
+	*t_gps = is_locked ? timebase.offset + timebase.rate*(t - timebase.t_ref) : -1;
+	
+	pthread_mutex_unlock(&timebase_lock);
+	
+	return is_locked;
+}
+
+
+//utc calendar time of monotonic timestamp t, returns 1 if the time of day is from gps
+//gps only provides the time of day, the date always comes from the system clock
+int utcTime(double t, struct tm* utc)
+{
+	struct timespec now_real, now_mono;
+	double t_gps;
+	
+	clock_gettime(CLOCK_REALTIME, &now_real);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now_mono);
+	
+	//system clock at t rather than now, so a run crossing midnight keeps its start date
+	double real = now_real.tv_sec + now_real.tv_nsec*1e-9 - (now_mono.tv_sec + now_mono.tv_nsec*1e-9 - t);
+	int is_gps = gpsTime(t, &t_gps);
+	
+	//take the day nearest the system clock for the gps time of day
+	if (is_gps)
+	{
+		double tod = fmod(t_gps, SECONDS_PER_DAY);
+		real = floor((real - tod)/SECONDS_PER_DAY + 0.5)*SECONDS_PER_DAY + tod;
+	}
+	
+	time_t rawtime = (time_t)floor(real);
+	gmtime_r(&rawtime, utc);
+	
+	return is_gps;
+}
+
+
+void getTimebase(Timebase* model)
+{
+	pthread_mutex_lock(&timebase_lock);
+	*model = timebase;
+	pthread_mutex_unlock(&timebase_lock);
+}
+
+
+//record the gps reference of the run, t_start is the monotonic trigger time of the first ramp
+void writeTimebaseSummary(FILE* summaryFile, double t_start)
+{
+	Timebase model;
+	double t_gps;
+	
+	getTimebase(&model);
+	gpsTime(t_start, &t_gps);
+	
+	//date of the first ramp, not of the end of the run
+	struct tm tm;
+	utcTime(t_start, &tm);
+	
+	fprintf(summaryFile, "\n[timebase]\r\n");
+	fprintf(summaryFile, "gps_locked = %i\r\n", model.is_locked);
+	fprintf(summaryFile, "gps_fixes = %i\r\n", model.n_fixes);
+	fprintf(summaryFile, "utc_date = %04d-%02d-%02d\r\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+	fprintf(summaryFile, "; fixes are stamped when the gps packet arrives over the uart, the um7 output latency after the gps epoch is not corrected\r\n");
+	fprintf(summaryFile, "; utc_date is taken from the system clock\r\n");
+	
+	if (model.is_locked)
+	{
+		double tod = fmod(t_gps, SECONDS_PER_DAY);
+		
+		fprintf(summaryFile, "start_gps_time = %.6f\r\n", t_gps);
+		fprintf(summaryFile, "start_utc = %02d:%02d:%09.6f\r\n", (int)(tod/3600), ((int)tod % 3600)/60, fmod(tod, 60));
+		fprintf(summaryFile, "clock_drift_ppm = %.3f\r\n", (model.rate - 1)*1e6);
+		fprintf(summaryFile, "fit_residual_us = %.1f\r\n", model.residual*1e6);
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TIMEBASE_WINDOW			64			//number of gps fixes used in the offset and drift fit
+#define TIMEBASE_MIN_FIXES		4			//fixes required before gps time is reported
+#define SECONDS_PER_DAY			86400.0
+
+typedef struct
+{
+	int n_fixes;							//gps fixes received in total
+	int is_locked;							//enough fixes for a fit
+	double t_ref;							//reference point of the fit [s, CLOCK_MONOTONIC_RAW]
+	double offset;							//gps time at t_ref [s since utc midnight of the first fix]
+	double rate;							//gps seconds per monotonic second
+	double residual;						//rms fit residual [s]
+} Timebase;
+
+void   initTimebase(void);
+void   updateTimebase(float gps_time, double t);
+int    gpsTime(double t, double* t_gps);
+int    utcTime(double t, struct tm* utc);
+void   getTimebase(Timebase* model);
+double hmsToSeconds(float hhmmss);
+void   writeTimebaseSummary(FILE* summaryFile, double t_start);
+
+#endif
@@ -0,0 +1,152 @@
+#include "trace.h"
+#include "controller.h"
+#include "colour.h"
+
+//optional timeline of the capture pipeline. every thread records complete
+//spans (begin and duration) into one preallocated ring, claimed with an
+//atomic increment, and the ring is written as chrome trace event json
+//after the collection. load the file in chrome://tracing or ui.perfetto.dev.
+//the ring keeps the newest TRACE_MAX_EVENTS spans, so a long flight is traced
+//over its last stretch (about 100 s at 10 spans per ramp and 1 kHz), where a
+//collection that went bad is usually stopped.
+
+static const char* phase_names[TRACE_PHASES] = {
+	"ramp", "transfer", "acq_start", "trigger_source", "gap", "commit", 
+	"measure", "preview", "store", "uart_read", "imu_write", "imu_decode"
+};
+
+static TraceSpan* spans = NULL;
+static uint32_t n_spans = 0;
+static uint32_t n_overwritten = 0;
+static double t_origin = 0;
+static int is_tracing = 0;
+
+static const char* thread_names[TRACE_MAX_THREADS] = {"other"};
+static uint32_t n_threads = 1;
+static __thread uint16_t thread_id = 0;
+
+
+//allocate the span buffer on the first collection and start recording
+int initTrace(void)
+{
+	if (!spans)
+		spans = (TraceSpan*)malloc(TRACE_MAX_EVENTS*sizeof(TraceSpan));
+	
+	if (!spans)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not allocate the trace buffer.\n");
+		return 0;
+	}
+	
+	n_spans = 0;
+	n_overwritten = 0;
+	t_origin = monotonicTime();
+	__atomic_store_n(&is_tracing, 1, __ATOMIC_RELEASE);
+	
+	return 1;
+}
+
+
+//name the calling thread on the timeline, name must be a string literal
+void traceThread(const char* name)
+{
+	for (uint32_t i = 0; i < n_threads; i++)
+	{
+		if (thread_names[i] == name)
+		{
+			thread_id = i;
+			return;
+		}
+	}
+	
+	uint32_t id = __atomic_fetch_add(&n_threads, 1, __ATOMIC_RELAXED);
+	
+	if (id < TRACE_MAX_THREADS)
+	{
+		thread_names[id] = name;
+		thread_id = id;
+	}
+}
+
+
+//begin time of a span, 0 when tracing is off
+double traceTime(void)
+{
+	return __atomic_load_n(&is_tracing, __ATOMIC_RELAXED) ? monotonicTime() : 0;
+}
+
+
+void traceSpan(int phase, double t_begin, uint32_t ramp)
+{
+	if (!__atomic_load_n(&is_tracing, __ATOMIC_RELAXED) || t_begin == 0)
+		return;
+	
+	double t_end = monotonicTime();
+	uint32_t i = __atomic_fetch_add(&n_spans, 1, __ATOMIC_RELAXED) & (TRACE_MAX_EVENTS - 1);
+	
+	spans[i].t_begin = t_begin;
+	spans[i].duration = t_end - t_begin;
+	spans[i].ramp = ramp;
+	spans[i].phase = phase;
+	spans[i].thread = thread_id;
+}
+
+
+const char* tracePhaseName(int phase)
+{
+	return (phase >= 0 && phase < TRACE_PHASES) ? phase_names[phase] : "unknown";
+}
+
+
+//stop recording and write the spans as chrome trace json, call once the threads have been joined
+int writeTrace(const char* filename)
+{
+	if (!__atomic_load_n(&is_tracing, __ATOMIC_ACQUIRE))
+		return 1;
+	
+	__atomic_store_n(&is_tracing, 0, __ATOMIC_RELEASE);
+	
+	FILE* file = fopen(filename, "w");
+	
+	if (!file)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open %s.\n", filename);
+		return 0;
+	}
+	
+	//oldest span still in the ring first
+	uint32_t n = (n_spans < TRACE_MAX_EVENTS) ? n_spans : TRACE_MAX_EVENTS;
+	uint32_t first = n_spans - n;
+	
+	n_overwritten = first;
+	uint32_t n_named = (n_threads < TRACE_MAX_THREADS) ? n_threads : TRACE_MAX_THREADS;
+	
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"overwritten\":%u},\"traceEvents\":[\n", n_overwritten);
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rpc\"}}");
+	
+	for (uint32_t i = 0; i < n_named; i++)
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", i, thread_names[i]);
+	
+	for (uint32_t k = 0; k < n; k++)
+	{
+		const uint32_t i = (first + k) & (TRACE_MAX_EVENTS - 1);
+		
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"ramp\":%u}}", 
+			phase_names[spans[i].phase], (spans[i].t_begin - t_origin)*1e6, spans[i].duration*1e6, spans[i].thread, spans[i].ramp);
+	}
+	
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("Trace: %u spans written to %s", n, filename);
+	
+	if (n_overwritten)
+		printf(", %u older spans overwritten", n_overwritten);
+	
+	printf("\n");
+	
+	return 1;
+}
@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRACE_MAX_EVENTS		(1 << 20)	//ring of the newest spans, about 24 MB, power of two
+#define TRACE_MAX_THREADS		8
+
+//phases of the capture pipeline, names in trace.c
+enum
+{
+	TRACE_RAMP,								//capture loop, trigger detected to loop end
+	TRACE_TRANSFER,							//rp_AcqGetLatestDataRaw
+	TRACE_ACQ_START,						//rp_AcqStart
+	TRACE_TRIGGER_SOURCE,					//rp_AcqSetTriggerSrc
+	TRACE_GAP,								//countGap and pushRamp
+	TRACE_COMMIT,							//commitWriterSlot
+	TRACE_MEASURE,							//writer: measureRamp
+	TRACE_PREVIEW,							//writer: publishPreview
+	TRACE_STORE,							//writer: storeRamp, packing and fwrite
+	TRACE_UART_READ,						//imu: getUART
+	TRACE_IMU_WRITE,						//imu: fwrite of the raw stream
+	TRACE_IMU_DECODE,						//imu: processUART
+	TRACE_PHASES
+};
+
+typedef struct
+{
+	double t_begin;							//[s, CLOCK_MONOTONIC_RAW]
+	float duration;							//[s]
+	uint32_t ramp;
+	uint16_t phase;
+	uint16_t thread;
+} TraceSpan;
+
+int    initTrace(void);
+void   traceThread(const char* name);
+double traceTime(void);
+void   traceSpan(int phase, double t_begin, uint32_t ramp);
+const char* tracePhaseName(int phase);
+int    writeTrace(const char* filename);
+
+#endif
@@ -6,19 +6,36 @@ int uart_fd = -1;
 // UART buffer
 uint8_t* uart_buffer;
 
+//waits for bytes and returns as soon as any arrive, so the caller can stamp them
+//on arrival. returns 0 if none arrived within UART_POLL_TIMEOUT
 int getUART(void)
 {
-	// don't block serial read 
-	fcntl(uart_fd, F_SETFL, FNDELAY); 
+	struct pollfd uart_poll = {uart_fd, POLLIN, 0};
 	
 	if (uart_fd == -1)
 	{
 		cprint("[!!] ", BRIGHT, RED);
 		printf("UART has not been initialized.\n");
+		return 0;
 	}
   
 	while(1)
 	{
+		//block until the um7 sends rather than spinning on the auxiliary core
+		int n_ready = poll(&uart_poll, 1, UART_POLL_TIMEOUT);
+		
+		if (n_ready == 0)
+			return 0;
+		
+		if (n_ready < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			
+			printf("Error polling UART.\n");
+			return 0;
+		}
+		
 		// perform uart read
 		int rx_length = read(uart_fd, (void*)uart_buffer, UART_BUFFER_SIZE);
 		
@@ -34,18 +51,20 @@ int getUART(void)
 			else
 			{
 				printf("Error reading from UART.\n");
+				return 0;
 			}
 		  
 		}
 		else
 		{	
+			simCorrupt(uart_buffer, rx_length);
 			return rx_length;
 		}
 	}  
 }
 
 
-void initUART(speed_t baud)
+void initUART(const char* device, speed_t baud)
 {
 	//close any open connection and flush UART 
 	dnitUART();
@@ -54,12 +73,12 @@ void initUART(speed_t baud)
 	uart_buffer = (uint8_t*)malloc(UART_BUFFER_SIZE*sizeof(uint8_t));
 	
 	//open connection to UART
-	uart_fd = open("/dev/ttyPS1", O_RDWR | O_NOCTTY | O_NDELAY);
+	uart_fd = open(device, O_RDWR | O_NOCTTY | O_NDELAY);
 
 	if(uart_fd == -1)
 	{
 		cprint("[!!] ", BRIGHT, RED);
-		fprintf(stderr, "Failed to init UART.\n");
+		fprintf(stderr, "Failed to init UART on %s.\n", device);
 		exit(EXIT_FAILURE);
 	}
 	
@@ -96,8 +115,12 @@ void initUART(speed_t baud)
 	settings.c_cflag &= ~CSTOPB; /* 1 stop bit */
 	settings.c_cflag &= ~CSIZE;
 	settings.c_cflag |= CS8 | CLOCAL; /* 8 bits */
-	settings.c_lflag = ICANON; /* canonical mode */
+	settings.c_cflag |= CREAD; /* enable receiver */
+	settings.c_lflag = 0; /* raw input, um7 packets are binary and have no line ends */
+	settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON); /* no cr/nl mapping or flow control bytes */
 	settings.c_oflag &= ~OPOST; /* raw output */
+	settings.c_cc[VMIN] = 1; /* reads without data fail with EAGAIN rather than return 0 */
+	settings.c_cc[VTIME] = 0;
 
 	/* Setting attributes */
 	tcflush(uart_fd, TCIFLUSH);
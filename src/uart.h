@@ -10,12 +10,17 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
 
 #include "colour.h"
+#include "sim.h"
 
 #define UART_BUFFER_SIZE 200
+#define UART_DEVICE "/dev/ttyPS1"
+#define UART_POLL_TIMEOUT 100		//wait for bytes at most [ms]
+#define UART_BYTE_TIME (10/115200.0)	//start, 8 data and stop bit at 115200 baud [s]
 
-void initUART(speed_t baud);
+void initUART(const char* device, speed_t baud);
 int dnitUART(void);
 int getUART(void);
 int getFileID(void);
@@ -0,0 +1,613 @@
+#define _GNU_SOURCE
+#include "writer.h"
+
+//single producer (capture loop) single consumer (writer thread) ring of ramp slots
+static RampMeta slot_meta[WRITER_SLOTS];
+static int16_t* slot_samples = NULL;
+static uint32_t slot_head = 0;
+static uint32_t slot_tail = 0;
+
+//ramps are transferred here when the ring is full and are then discarded
+static int16_t* scratch_samples = NULL;
+static RampMeta scratch_meta;
+static int is_scratch = 0;
+static int n_dropped = 0;
+
+static uint32_t ns_ramp = 0;
+static const char* capture_filename;
+static CaptureHeader capture_header;
+static CaptureFile capture;
+static pthread_t writer_thread;
+static int is_writer_active = 0;
+static int is_writer_ok = 1;
+
+//segment rollover limits, zero for unlimited
+static uint64_t segment_bytes = 0;
+static uint32_t segment_ramps = 0;
+static Segment segments[WRITER_MAX_SEGMENTS];
+static int n_segments = 0;
+
+//background preallocation of the next segment file
+static pthread_t allocator_thread;
+static pthread_mutex_t allocator_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t allocator_cond = PTHREAD_COND_INITIALIZER;
+static int allocator_request = -1;			//segment waiting to be allocated
+static int allocator_busy = -1;				//segment being allocated
+static int allocated_segment = -1;			//segment held in allocated_file
+static FILE* allocated_file = NULL;
+static int is_allocator_active = 0;
+
+//placeholder ramps written in place of missed triggers
+static int is_placeholder = 0;
+static int16_t* zero_samples = NULL;
+static uint32_t next_ramp = 0;
+static double t_last = 0;
+static int n_placeholders = 0;
+
+//totals over all segments
+static uint64_t raw_bytes = 0;
+static uint64_t stored_bytes = 0;
+static double codec_time = 0;
+
+static void* runWriter(void* arg);
+static int  storeRamp(const int16_t* samples, RampMeta* meta);
+static int  storePlaceholders(const RampMeta* meta);
+static void* runAllocator(void* arg);
+static int  openSegment(int segment, uint32_t first_ramp);
+static int  closeSegment(void);
+static FILE* takeSegmentFile(int segment);
+static void stopAllocator(void);
+static void requestSegment(int segment);
+static void freeBuffers(void);
+
+
+int initWriter(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo, int cpu)
+{
+	ns_ramp = experiment->ns_ext_buffer;
+	slot_head = 0;
+	slot_tail = 0;
+	n_dropped = 0;
+	n_segments = 0;
+	raw_bytes = 0;
+	stored_bytes = 0;
+	codec_time = 0;
+	is_writer_ok = 1;
+	is_placeholder = experiment->is_placeholder;
+	next_ramp = 0;
+	t_last = 0;
+	n_placeholders = 0;
+	initQuality();
+	initPreview(experiment->preview_every, ADC_RATE/experiment->decFactor, experiment->timeStamp);
+	
+	segment_bytes = experiment->segment_size*1e6;
+	segment_ramps = experiment->segment_ramps;
+	
+	slot_samples = (int16_t*)malloc(WRITER_SLOTS*ns_ramp*sizeof(int16_t));
+	scratch_samples = (int16_t*)malloc(ns_ramp*sizeof(int16_t));
+	zero_samples = (int16_t*)calloc(ns_ramp, sizeof(int16_t));
+	
+	if (!slot_samples || !scratch_samples || !zero_samples)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not allocate writer buffers.\n");
+		freeBuffers();
+		return 0;
+	}
+	
+	fillCaptureHeader(&capture_header, experiment, synthOne, synthTwo);
+	capture_filename = experiment->ch1_filename;
+	
+	allocator_request = -1;
+	allocator_busy = -1;
+	allocated_segment = -1;
+	allocated_file = NULL;
+	is_allocator_active = 1;
+	
+	if (pthread_create(&allocator_thread, NULL, runAllocator, NULL))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Error launching allocator thread.\n");
+		freeBuffers();
+		return 0;
+	}
+	
+	pinThread(allocator_thread, cpu);
+	
+	if (!openSegment(0, 0))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open %s.\n", experiment->ch1_filename);
+		stopAllocator();
+		freeBuffers();
+		return 0;
+	}
+	
+	is_writer_active = 1;
+	
+	if (pthread_create(&writer_thread, NULL, runWriter, NULL))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Error launching writer thread.\n");
+		is_writer_active = 0;
+		closeCaptureFile(&capture);
+		stopAllocator();
+		freeBuffers();
+		return 0;
+	}
+	
+	//chunk assembly, crc and file io stay off the acquisition core
+	pinThread(writer_thread, cpu);
+	
+	return 1;
+}
+
+
+//drain the ring and close the container, returns 0 if any write failed
+int dnitWriter(void)
+{
+	is_writer_active = 0;
+	pthread_join(writer_thread, NULL);
+	closePreview();
+	
+	closeSegment();
+	
+	stopAllocator();
+	freeBuffers();
+	
+	if (n_dropped > 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Ramps dropped by writer: %i\n", n_dropped);
+	}
+	
+	if ((capture_header.sample_format != SAMPLE_FORMAT_INT16) && (stored_bytes > 0))
+	{
+		cprint("[**] ", BRIGHT, CYAN);
+		printf("Storage ratio: %.2f (%s), codec %.1f MB/s\n", (double)raw_bytes/stored_bytes, 
+			sampleFormatName(capture_header.sample_format), (codec_time > 0) ? raw_bytes/codec_time/1e6 : 0);
+	}
+	
+	if (n_placeholders > 0)
+	{
+		cprint("[**] ", BRIGHT, CYAN);
+		printf("Placeholder ramps written: %i\n", n_placeholders);
+	}
+	
+	if (n_segments > 1)
+	{
+		cprint("[**] ", BRIGHT, CYAN);
+		printf("Segments written: %i\n", n_segments);
+	}
+	
+	if (!is_writer_ok)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Writing %s failed.\n", capture_filename);
+	}
+	
+	return is_writer_ok;
+}
+
+
+//segment files are numbered ext_000.cap, ext_001.cap, ... when rollover is enabled
+void segmentName(char* filename, const char* base, int segment)
+{
+	const char* extension = strrchr(base, '.');
+	int stem = extension ? extension - base : (int)strlen(base);
+	
+	if (!segment_bytes && !segment_ramps)
+		snprintf(filename, WRITER_FILENAME_SIZE, "%s", base);
+	else
+		snprintf(filename, WRITER_FILENAME_SIZE, "%.*s_%03d%s", stem, base, segment, extension ? extension : "");
+}
+
+
+static int openSegment(int segment, uint32_t first_ramp)
+{
+	if (segment >= WRITER_MAX_SEGMENTS)
+		return 0;
+	
+	FILE* file = takeSegmentFile(segment);
+	
+	if (!file)
+		return 0;
+	
+	capture_header.segment = segment;
+	capture_header.first_ramp = first_ramp;
+	
+	//closes the file if it fails
+	if (!attachCaptureFile(&capture, file, &capture_header))
+		return 0;
+	
+	segmentName(segments[segment].filename, capture_filename, segment);
+	segments[segment].first_ramp = first_ramp;
+	segments[segment].n_ramps = 0;
+	segments[segment].stored_bytes = 0;
+	n_segments = segment + 1;
+	
+	return 1;
+}
+
+
+//no-op when no segment is open, e.g. after a failed rollover
+static int closeSegment(void)
+{
+	if (!capture.file)
+		return 1;
+	
+	Segment* segment = &segments[n_segments - 1];
+	
+	segment->n_ramps = capture.n_ramps;
+	segment->stored_bytes = capture.offset;
+	raw_bytes += capture.raw_bytes;
+	stored_bytes += capture.stored_bytes;
+	codec_time += capture.codec_time;
+	
+	if (!closeCaptureFile(&capture))
+	{
+		is_writer_ok = 0;
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+//stop the allocator and remove an unused preallocated segment
+static void stopAllocator(void)
+{
+	pthread_mutex_lock(&allocator_lock);
+	is_allocator_active = 0;
+	pthread_cond_broadcast(&allocator_cond);
+	pthread_mutex_unlock(&allocator_lock);
+	pthread_join(allocator_thread, NULL);
+	
+	if (allocated_file)
+	{
+		char filename[WRITER_FILENAME_SIZE];
+		
+		segmentName(filename, capture_filename, allocated_segment);
+		fclose(allocated_file);
+		remove(filename);
+		allocated_file = NULL;
+	}
+}
+
+
+//release the ring, scratch and placeholder samples, also after a failed initWriter
+static void freeBuffers(void)
+{
+	free(slot_samples);
+	free(scratch_samples);
+	free(zero_samples);
+	slot_samples = NULL;
+	scratch_samples = NULL;
+	zero_samples = NULL;
+}
+
+
+//returns the preallocated file for the segment, waiting if it is still being prepared
+static FILE* takeSegmentFile(int segment)
+{
+	FILE* file = NULL;
+	
+	pthread_mutex_lock(&allocator_lock);
+	
+	while ((allocator_request == segment) || (allocator_busy == segment))
+		pthread_cond_wait(&allocator_cond, &allocator_lock);
+	
+	if (allocated_segment == segment)
+	{
+		file = allocated_file;
+		allocated_file = NULL;
+		allocated_segment = -1;
+	}
+	
+	pthread_mutex_unlock(&allocator_lock);
+	
+	//not requested in time, open it here
+	if (!file)
+	{
+		char filename[WRITER_FILENAME_SIZE];
+		
+		segmentName(filename, capture_filename, segment);
+		file = fopen(filename, "wb");
+	}
+	
+	return file;
+}
+
+
+static void requestSegment(int segment)
+{
+	pthread_mutex_lock(&allocator_lock);
+	
+	if ((allocator_request != segment) && (allocator_busy != segment) && (allocated_segment != segment))
+	{
+		allocator_request = segment;
+		pthread_cond_broadcast(&allocator_cond);
+	}
+	
+	pthread_mutex_unlock(&allocator_lock);
+}
+
+
+//opens and reserves disk space for upcoming segments
+static void* runAllocator(void* arg)
+{
+	char filename[WRITER_FILENAME_SIZE];
+	
+	pthread_mutex_lock(&allocator_lock);
+	
+	while (is_allocator_active)
+	{
+		if (allocator_request < 0 || allocated_file)
+		{
+			pthread_cond_wait(&allocator_cond, &allocator_lock);
+			continue;
+		}
+		
+		int segment = allocator_request;
+		allocator_request = -1;
+		allocator_busy = segment;
+		pthread_mutex_unlock(&allocator_lock);
+		
+		segmentName(filename, capture_filename, segment);
+		FILE* file = fopen(filename, "wb");
+		
+		//reserve the blocks without changing the file size so the trailer stays at the end
+		if (file)
+		{
+			uint64_t expected = segment_bytes;
+			
+			if (!expected)
+				expected = (uint64_t)segment_ramps*(captureRampBytes(&capture_header) + sizeof(RampMeta)) + sizeof(CaptureHeader);
+			
+			fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, expected);
+		}
+		
+		pthread_mutex_lock(&allocator_lock);
+		allocated_file = file;
+		allocated_segment = file ? segment : -1;
+		allocator_busy = -1;
+		pthread_cond_broadcast(&allocator_cond);
+	}
+	
+	pthread_mutex_unlock(&allocator_lock);
+	
+	return NULL;
+}
+
+
+//called from the capture loop, returns the buffer the next ramp should be transferred into
+int16_t* getWriterSlot(RampMeta** meta)
+{
+	uint32_t head = __atomic_load_n(&slot_head, __ATOMIC_RELAXED);
+	uint32_t tail = __atomic_load_n(&slot_tail, __ATOMIC_ACQUIRE);
+	
+	//never block the capture loop, the ramp is lost instead
+	if (head - tail == WRITER_SLOTS)
+	{
+		is_scratch = 1;
+		*meta = &scratch_meta;
+		return scratch_samples;
+	}
+	
+	is_scratch = 0;
+	*meta = &slot_meta[head & (WRITER_SLOTS - 1)];
+	
+	return &slot_samples[(head & (WRITER_SLOTS - 1))*ns_ramp];
+}
+
+
+//hand the slot returned by getWriterSlot over to the writer thread
+void commitWriterSlot(void)
+{
+	if (is_scratch)
+	{
+		n_dropped++;
+		return;
+	}
+	
+	__atomic_store_n(&slot_head, slot_head + 1, __ATOMIC_RELEASE);
+}
+
+
+int getWriterDropped(void)
+{
+	return n_dropped;
+}
+
+
+void writeWriterSummary(FILE* summaryFile)
+{
+	fprintf(summaryFile, "\n[storage]\r\n");
+	fprintf(summaryFile, "sample_format = %s\r\n", sampleFormatName(capture_header.sample_format));
+	fprintf(summaryFile, "raw_size = %.2f\r\n", raw_bytes/1e6);
+	fprintf(summaryFile, "stored_size = %.2f\r\n", stored_bytes/1e6);
+	fprintf(summaryFile, "storage_ratio = %.3f\r\n", (stored_bytes > 0) ? (double)raw_bytes/stored_bytes : 0);
+	fprintf(summaryFile, "codec_throughput = %.1f\r\n", (codec_time > 0) ? raw_bytes/codec_time/1e6 : 0);
+	fprintf(summaryFile, "writer_dropped = %i\r\n", n_dropped);
+	fprintf(summaryFile, "placeholder_ramps = %i\r\n", n_placeholders);
+	
+	fprintf(summaryFile, "\n[segments]\r\n");
+	fprintf(summaryFile, "n_segments = %i\r\n", n_segments);
+	
+	for (int i = 0; i < n_segments; i++)
+	{
+		const char* name = strrchr(segments[i].filename, '/');
+		
+		fprintf(summaryFile, "segment_%03d = %s\r\n", i, name ? name + 1 : segments[i].filename);
+		fprintf(summaryFile, "segment_%03d_ramps = %u %u\r\n", i, segments[i].first_ramp, segments[i].n_ramps);
+	}
+}
+
+
+static void* runWriter(void* arg)
+{
+	traceThread("writer");
+	openCounters();
+	
+	while (1)
+	{
+		uint32_t head = __atomic_load_n(&slot_head, __ATOMIC_ACQUIRE);
+		uint32_t tail = __atomic_load_n(&slot_tail, __ATOMIC_RELAXED);
+		
+		if (head == tail)
+		{
+			if (!is_writer_active)
+				break;
+			
+			usleep(1e3);
+			continue;
+		}
+		
+		RampMeta* meta = &slot_meta[tail & (WRITER_SLOTS - 1)];
+		int is_stored = 1;
+		
+		//fill missed and dropped ramps so that the file index stays the along-track index
+		if (is_placeholder && meta->ramp > next_ramp)
+			is_stored = storePlaceholders(meta);
+		
+		if (is_stored)
+		{
+			int16_t* samples = &slot_samples[(tail & (WRITER_SLOTS - 1))*ns_ramp];
+			
+			PhaseProbe phase;
+			
+			beginPhase(&phase);
+			measureRamp(samples, ns_ramp, meta);
+			endPhase(TRACE_MEASURE, &phase, meta->ramp);
+			
+			beginPhase(&phase);
+			publishPreview(samples, ns_ramp, meta);
+			endPhase(TRACE_PREVIEW, &phase, meta->ramp);
+			
+			simStall(meta->ramp);
+			
+			beginPhase(&phase);
+			is_stored = storeRamp(samples, meta);
+			endPhase(TRACE_STORE, &phase, meta->ramp);
+		}
+		
+		__atomic_store_n(&slot_tail, tail + 1, __ATOMIC_RELEASE);
+		
+		if (!is_stored)
+			break;
+	}
+	
+	closeCounters();
+	
+	return NULL;
+}
+
+
+//append a ramp to the current segment and roll over when it is full, returns 0 if rollover failed
+static int storeRamp(const int16_t* samples, RampMeta* meta)
+{
+	gpsTime(meta->t, &meta->t_gps);
+	
+	if (!appendCaptureRamp(&capture, samples, meta))
+		is_writer_ok = 0;
+	
+	next_ramp = meta->ramp + 1;
+	t_last = meta->t;
+	
+	if (!segment_bytes && !segment_ramps)
+		return 1;
+	
+	//prepare the next segment once this one is half full
+	int is_half = (segment_ramps && (2*capture.n_ramps >= segment_ramps)) || (segment_bytes && (2*capture.offset >= segment_bytes));
+	
+	if (is_half)
+		requestSegment(n_segments);
+	
+	//byte limited segments roll over on chunk boundaries
+	int is_full = (segment_ramps && (capture.n_ramps >= segment_ramps)) || 
+		(segment_bytes && (capture.chunk_fill == 0) && (capture.offset >= segment_bytes));
+	
+	if (is_full)
+	{
+		uint32_t first_ramp = segments[n_segments - 1].first_ramp + capture.n_ramps;
+		
+		closeSegment();
+		
+		if (!openSegment(n_segments, first_ramp))
+		{
+			logEvent(LOG_WARN, "Segment rollover failed.\n");
+			is_writer_ok = 0;
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+
+//zero ramps for the triggers missed or dropped before meta, trigger times spread evenly over the gap
+static int storePlaceholders(const RampMeta* meta)
+{
+	uint32_t gap = meta->ramp - next_ramp;
+	
+	if (next_ramp == 0 || meta->ramp <= next_ramp || gap > GAP_PLACEHOLDER_MAX)
+		return 1;
+	
+	double t_first = t_last;
+	double step = (meta->t - t_first)/(gap + 1);
+	
+	for (uint32_t i = 0; i < gap; i++)
+	{
+		RampMeta placeholder;
+		
+		memset(&placeholder, 0, sizeof(RampMeta));
+		placeholder.ramp = meta->ramp - gap + i;
+		placeholder.flags = RAMP_PLACEHOLDER;
+		placeholder.t = t_first + (i + 1)*step;
+		
+		if (!storeRamp(zero_samples, &placeholder))
+			return 0;
+		
+		n_placeholders++;
+	}
+	
+	return 1;
+}
+
+
+//copy the experiment and synthesizer state into a container header
+void fillCaptureHeader(CaptureHeader* header, Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo)
+{
+	Synthesizer* synths[2] = {synthOne, synthTwo};
+	
+	memset(header, 0, sizeof(CaptureHeader));
+	
+	header->chunk_ramps = CAPTURE_CHUNK_RAMPS;
+	header->ns_ramp = experiment->ns_ext_buffer;
+	header->sample_format = experiment->sample_format;
+	header->decimation = experiment->decFactor;
+	header->adc_channel = experiment->adc_channel;
+	header->n_ramps = experiment->n_ramps;
+	header->sample_rate = ADC_RATE/experiment->decFactor;
+	strncpy(header->timestamp, experiment->timeStamp, sizeof(header->timestamp) - 1);
+	strncpy(header->rpc_version, VERSION, sizeof(header->rpc_version) - 1);
+	
+	for (int s = 0; s < 2; s++)
+	{
+		header->synth[s].fractional_numerator = synths[s]->fractionalNumerator;
+		header->synth[s].frequency_offset = vcoOut(synths[s]->fractionalNumerator);
+		
+		for (int i = 0; i < MAX_RAMPS; i++)
+		{
+			Ramp* ramp = &synths[s]->ramps[i];
+			
+			header->synth[s].ramps[i].increment = ramp->increment;
+			header->synth[s].ramps[i].bandwidth = bnwOut(ramp->increment, ramp->length);
+			header->synth[s].ramps[i].length = ramp->length;
+			header->synth[s].ramps[i].next = ramp->next;
+			header->synth[s].ramps[i].trigger = ramp->trigger;
+			header->synth[s].ramps[i].reset = ramp->reset;
+			header->synth[s].ramps[i].flag = ramp->flag;
+			header->synth[s].ramps[i].doubler = ramp->doubler;
+		}
+	}
+}
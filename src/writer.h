@@ -0,0 +1,45 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "controller.h"
+#include "capture.h"
+#include "timebase.h"
+#include "gaps.h"
+#include "quality.h"
+#include "preview.h"
+#include "counters.h"
+#include "sim.h"
+#include "colour.h"
+
+#define WRITER_SLOTS			256			//ramps buffered between the capture loop and the writer (power of 2)
+#define WRITER_MAX_SEGMENTS		1000
+#define WRITER_FILENAME_SIZE	100
+
+typedef struct
+{
+	char filename[WRITER_FILENAME_SIZE];
+	uint32_t first_ramp;
+	uint32_t n_ramps;
+	uint64_t stored_bytes;
+} Segment;
+
+int  initWriter(Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo, int cpu);
+int  dnitWriter(void);
+
+int16_t* getWriterSlot(RampMeta** meta);
+void commitWriterSlot(void);
+int  getWriterDropped(void);
+void writeWriterSummary(FILE* summaryFile);
+
+void segmentName(char* filename, const char* base, int segment);
+void fillCaptureHeader(CaptureHeader* header, Experiment *experiment, Synthesizer *synthOne, Synthesizer *synthTwo);
+
+#endif
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "capture.h"
+#include "npy.h"
+
+//converts capture containers into numpy arrays with one ramp per row, decoding
+//the chunks on all cores straight into the mapped output. the segment files of a
+//recording are given in order and become one array.
+//
+//  <out>.npy          int16 samples, or float32 after dc removal or windowing
+//  <out>_<k>.npy      section k of every ramp with -s (e.g. the up and down sweep)
+//  <out>_meta.npy     ramp index, flags, trigger times and ramp stats per row
+//
+//usage: ./cap2npy [-o out] [-j threads] [-d] [-w window] [-s sections] [-f] [-c] ext.cap [ext_1.cap ...]
+
+#define MAX_SEGMENTS			256
+#define MAX_SECTIONS			16
+
+#define WINDOW_NONE				0
+#define WINDOW_HANN				1
+#define WINDOW_HAMMING			2
+#define WINDOW_BLACKMAN			3
+
+typedef struct
+{
+	uint32_t ramp;
+	uint32_t flags;
+	double t;
+	double t_gps;
+	float dc;
+	float rms;
+} MetaRow;
+
+#define META_DESCR "[('ramp', '<u4'), ('flags', '<u4'), ('t', '<f8'), ('t_gps', '<f8'), ('dc', '<f4'), ('rms', '<f4')]"
+
+static CaptureMap maps[MAX_SEGMENTS];
+static uint64_t first_row[MAX_SEGMENTS];
+static uint64_t first_chunk[MAX_SEGMENTS + 1];
+static int n_segments = 0;
+
+static NpyMap outputs[MAX_SECTIONS];
+static NpyMap meta_output;
+static int n_sections = 1;
+static uint32_t ns_section;
+static int is_float = 0;
+static int is_dc = 0;
+static int is_check = 0;
+static float* window = NULL;
+
+static uint64_t next_chunk = 0;
+static int n_bad_ramps = 0;
+static int n_bad_chunks = 0;
+
+static double elapsed(struct timespec start, struct timespec end)
+{
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+}
+
+
+static float* makeWindow(int type, uint32_t n)
+{
+	float* w = (float*)malloc(n*sizeof(float));
+	
+	for (uint32_t i = 0; i < n; i++)
+	{
+		double x = 2.0*M_PI*i/(n > 1 ? n - 1 : 1);
+		
+		switch (type)
+		{
+			case WINDOW_HANN:
+				w[i] = 0.5 - 0.5*cos(x);
+				break;
+			case WINDOW_HAMMING:
+				w[i] = 0.54 - 0.46*cos(x);
+				break;
+			case WINDOW_BLACKMAN:
+				w[i] = 0.42 - 0.5*cos(x) + 0.08*cos(2.0*x);
+				break;
+			default:
+				w[i] = 1.0f;
+		}
+	}
+	
+	return w;
+}
+
+
+//decode one ramp into its row of every section
+static void convertRamp(const int16_t* samples, uint64_t row)
+{
+	for (int k = 0; k < n_sections; k++)
+	{
+		const int16_t* section = samples + k*ns_section;
+		
+		if (!is_float)
+		{
+			memcpy((int16_t*)outputs[k].data + row*ns_section, section, ns_section*sizeof(int16_t));
+			continue;
+		}
+		
+		float* out = (float*)outputs[k].data + row*ns_section;
+		float dc = 0.0f;
+		
+		if (is_dc)
+		{
+			int64_t sum = 0;
+			
+			for (uint32_t i = 0; i < ns_section; i++)
+				sum += section[i];
+			
+			dc = (float)sum/ns_section;
+		}
+		
+		if (window)
+		{
+			for (uint32_t i = 0; i < ns_section; i++)
+				out[i] = (section[i] - dc)*window[i];
+		}
+		else
+		{
+			for (uint32_t i = 0; i < ns_section; i++)
+				out[i] = section[i] - dc;
+		}
+	}
+}
+
+
+//workers take whole chunks from a shared counter, so compressed chunks that decode slowly balance out
+static void* runConverter(void* arg)
+{
+	int16_t* samples = (int16_t*)malloc(maps[0].header->ns_ramp*sizeof(int16_t));
+	int bad_ramps = 0;
+	int bad_chunks = 0;
+	uint64_t chunk;
+	
+	(void)arg;
+	
+	while ((chunk = __atomic_fetch_add(&next_chunk, 1, __ATOMIC_RELAXED)) < first_chunk[n_segments])
+	{
+		int s = 0;
+		
+		while (chunk >= first_chunk[s + 1])
+			s++;
+		
+		CaptureMap* map = &maps[s];
+		uint32_t c = chunk - first_chunk[s];
+		uint32_t chunk_ramps = map->header->chunk_ramps;
+		
+		if (is_check && !checkCaptureChunk(map, c))
+			bad_chunks++;
+		
+		for (uint32_t r = c*chunk_ramps; r < (c + 1)*chunk_ramps && r < map->n_ramps; r++)
+		{
+			uint64_t row = first_row[s] + r;
+			MetaRow* meta_row = (MetaRow*)meta_output.data + row;
+			RampMeta* meta = NULL;
+			
+			if (!readCaptureRamp(map, r, samples, &meta))
+			{
+				memset(samples, 0, map->header->ns_ramp*sizeof(int16_t));
+				bad_ramps++;
+			}
+			
+			convertRamp(samples, row);
+			
+			if (meta)
+			{
+				meta_row->ramp = meta->ramp;
+				meta_row->flags = meta->flags;
+				meta_row->t = meta->t;
+				meta_row->t_gps = meta->t_gps;
+				meta_row->dc = meta->stats.dc;
+				meta_row->rms = meta->stats.rms;
+			}
+		}
+	}
+	
+	__atomic_add_fetch(&n_bad_ramps, bad_ramps, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&n_bad_chunks, bad_chunks, __ATOMIC_RELAXED);
+	free(samples);
+	
+	return NULL;
+}
+
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [options] <capture file> [<capture file> ...]\n", name);
+	fprintf(stderr, " -o out       output prefix (default ext), writes out.npy and out_meta.npy\n");
+	fprintf(stderr, " -j threads   worker threads (default all cores)\n");
+	fprintf(stderr, " -d           remove the mean of every ramp (float32 output)\n");
+	fprintf(stderr, " -w window    hann, hamming or blackman window (float32 output)\n");
+	fprintf(stderr, " -s sections  split every ramp into equal sections, written to out_0.npy ...\n");
+	fprintf(stderr, " -f           float32 output without processing\n");
+	fprintf(stderr, " -c           check the chunk crcs\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char* prefix = "ext";
+	int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int window_type = WINDOW_NONE;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "o:j:dw:s:fch")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				prefix = optarg;
+				break;
+			case 'j':
+				n_threads = atoi(optarg);
+				break;
+			case 'd':
+				is_dc = 1;
+				is_float = 1;
+				break;
+			case 'w':
+				if (!strcmp(optarg, "hann"))
+					window_type = WINDOW_HANN;
+				else if (!strcmp(optarg, "hamming"))
+					window_type = WINDOW_HAMMING;
+				else if (!strcmp(optarg, "blackman"))
+					window_type = WINDOW_BLACKMAN;
+				else
+				{
+					fprintf(stderr, "Unknown window %s.\n", optarg);
+					return EXIT_FAILURE;
+				}
+				is_float = 1;
+				break;
+			case 's':
+				n_sections = atoi(optarg);
+				break;
+			case 'f':
+				is_float = 1;
+				break;
+			case 'c':
+				is_check = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	
+	if (optind == argc || argc - optind > MAX_SEGMENTS || n_threads < 1 || n_sections < 1 || n_sections > MAX_SECTIONS)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	uint64_t n_rows = 0;
+	uint64_t input_bytes = 0;
+	
+	for (int i = optind; i < argc; i++, n_segments++)
+	{
+		CaptureMap* map = &maps[n_segments];
+		
+		if (!mapCapture(map, argv[i]))
+		{
+			fprintf(stderr, "%s is not a capture container.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		
+		if (map->header->ns_ramp != maps[0].header->ns_ramp)
+		{
+			fprintf(stderr, "%s has %u samples per ramp, %s has %u.\n", argv[i], map->header->ns_ramp, argv[optind], maps[0].header->ns_ramp);
+			return EXIT_FAILURE;
+		}
+		
+		if (map->is_recovered)
+			printf("%s has no valid index, recovered %u chunks\n", argv[i], map->n_chunks);
+		
+		first_row[n_segments] = n_rows;
+		first_chunk[n_segments + 1] = first_chunk[n_segments] + map->n_chunks;
+		n_rows += map->n_ramps;
+		input_bytes += map->size;
+	}
+	
+	uint32_t ns_ramp = maps[0].header->ns_ramp;
+	ns_section = ns_ramp/n_sections;
+	
+	if (ns_section*n_sections != ns_ramp)
+		printf("%u samples do not split into %i sections, dropping the last %u\n", ns_ramp, n_sections, ns_ramp - ns_section*n_sections);
+	
+	if (window_type != WINDOW_NONE)
+		window = makeWindow(window_type, ns_section);
+	
+	char filename[1024];
+	size_t item_size = is_float ? sizeof(float) : sizeof(int16_t);
+	
+	for (int k = 0; k < n_sections; k++)
+	{
+		if (n_sections == 1)
+			snprintf(filename, sizeof(filename), "%s.npy", prefix);
+		else
+			snprintf(filename, sizeof(filename), "%s_%i.npy", prefix, k);
+		
+		if (!createNpy(&outputs[k], filename, is_float ? "'<f4'" : "'<i2'", (uint64_t[]){n_rows, ns_section}, 2, item_size))
+		{
+			fprintf(stderr, "Could not create %s.\n", filename);
+			return EXIT_FAILURE;
+		}
+	}
+	
+	snprintf(filename, sizeof(filename), "%s_meta.npy", prefix);
+	
+	if (!createNpy(&meta_output, filename, META_DESCR, &n_rows, 1, sizeof(MetaRow)))
+	{
+		fprintf(stderr, "Could not create %s.\n", filename);
+		return EXIT_FAILURE;
+	}
+	
+	pthread_t* threads = (pthread_t*)malloc(n_threads*sizeof(pthread_t));
+	struct timespec start, converted, end;
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	for (int t = 0; t < n_threads; t++)
+	{
+		if (pthread_create(&threads[t], NULL, runConverter, NULL))
+		{
+			fprintf(stderr, "Could not start worker %i.\n", t);
+			n_threads = t;
+			break;
+		}
+	}
+	
+	for (int t = 0; t < n_threads; t++)
+		pthread_join(threads[t], NULL);
+	
+	clock_gettime(CLOCK_MONOTONIC, &converted);
+	
+	int is_written = 1;
+	
+	for (int k = 0; k < n_sections; k++)
+		is_written &= closeNpy(&outputs[k]);
+	
+	is_written &= closeNpy(&meta_output);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	double output_gb = (double)n_rows*ns_section*n_sections*item_size/1e9;
+	double raw_gb = (double)n_rows*ns_ramp*sizeof(int16_t)/1e9;
+	
+	printf("Ramps: %llu x %u samples (%s) from %i file(s)\n", (unsigned long long)n_rows, ns_ramp, sampleFormatName(maps[0].header->sample_format), n_segments);
+	printf("Input: %.3f GB, output: %.3f GB in %i section(s)\n", input_bytes/1e9, output_gb, n_sections);
+	printf("Converted in %.3f s on %i threads: %.2f GB/s of samples, %.2f GB/s read\n", elapsed(start, converted), n_threads,
+		raw_gb/elapsed(start, converted), input_bytes/1e9/elapsed(start, converted));
+	printf("Written back in %.3f s: %.2f GB/s overall\n", elapsed(converted, end), output_gb/elapsed(start, end));
+	
+	if (n_bad_chunks > 0)
+		printf("Chunks failing crc: %i\n", n_bad_chunks);
+	
+	if (n_bad_ramps > 0)
+		printf("Ramps failing to decode (zeroed): %i\n", n_bad_ramps);
+	
+	if (!is_written)
+		fprintf(stderr, "Could not write the output.\n");
+	
+	for (int s = 0; s < n_segments; s++)
+		unmapCapture(&maps[s]);
+	
+	free(threads);
+	free(window);
+	
+	return is_written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
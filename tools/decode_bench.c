@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "binary.h"
+
+//micro-benchmark of the um7 float decoders
+//usage: ./decode_bench [packets]
+
+#define N_BATCH 12
+
+static double elapsed_ns(struct timespec start, struct timespec end)
+{
+	return (end.tv_sec - start.tv_sec)*1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+	int n_packets = (argc > 1) ? atoi(argv[1]) : 100000;
+	
+	uint8_t* payload = (uint8_t*)malloc(n_packets*4*N_BATCH);
+	float* reference = (float*)malloc(n_packets*N_BATCH*sizeof(float));
+	float* batch = (float*)malloc(n_packets*N_BATCH*sizeof(float));
+	
+	//fill the payload with big-endian floats in the range seen from DREG_ALL_PROC
+	srand(1);
+	for (int i = 0; i < n_packets*N_BATCH; i++)
+	{
+		float value = ((float)rand()/RAND_MAX - 0.5f)*1000.0f;
+		uint32_t bit32;
+		memcpy(&bit32, &value, sizeof(float));
+		
+		payload[4*i + 0] = bit32 >> 24;
+		payload[4*i + 1] = bit32 >> 16;
+		payload[4*i + 2] = bit32 >> 8;
+		payload[4*i + 3] = bit32 >> 0;
+	}
+	
+	struct timespec start, end;
+	
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	for (int p = 0; p < n_packets; p++)
+	{
+		for (int i = 0; i < N_BATCH; i++)
+		{
+			reference[p*N_BATCH + i] = bit8ArrayToFloat(&payload[4*(p*N_BATCH + i)]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+	double ns_reference = elapsed_ns(start, end)/n_packets;
+	
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	for (int p = 0; p < n_packets; p++)
+	{
+		bit8ArrayToFloatBatch(&payload[4*p*N_BATCH], &batch[p*N_BATCH], N_BATCH);
+	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+	double ns_batch = elapsed_ns(start, end)/n_packets;
+	
+	int n_mismatch = 0;
+	for (int i = 0; i < n_packets*N_BATCH; i++)
+	{
+		if (reference[i] != batch[i]) n_mismatch++;
+	}
+	
+	printf("Packets: %i (%i floats each)\n", n_packets, N_BATCH);
+	printf("bit8ArrayToFloat:      %10.1f ns/packet\n", ns_reference);
+	printf("bit8ArrayToFloatBatch: %10.1f ns/packet\n", ns_batch);
+	printf("Speed-up: %.1fx\n", ns_reference/ns_batch);
+	printf("Mismatches: %i\n", n_mismatch);
+	
+	free(payload);
+	free(reference);
+	free(batch);
+	
+	return (n_mismatch == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
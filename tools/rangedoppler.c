@@ -0,0 +1,659 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <libgen.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "capture.h"
+#include "npy.h"
+#include "ini.h"
+
+//range-doppler maps of a recording, block by block on all cores
+//the range axis is calibrated from the sampled ramp in summary.ini (ramp_bandwidth
+//and ramp_duration of the synth section, the sample rate from decimation_factor),
+//the doppler axis from the trigger times in the capture. each block of ramps is
+//range transformed two real ramps per complex fft, then doppler transformed in
+//panels of range bins copied out contiguously, so both passes run in cache.
+//
+//  <out>.npy          float32 power [dB], blocks x doppler bins x range bins
+//  <out>_range.npy    range of every bin [m]
+//  <out>_doppler.npy  doppler frequency of every bin [Hz], zero in the middle
+//  <out>_blocks.npy   first ramp, ramps after a gap and mid time of every block
+//  <out>_<block>.pgm  8-bit tiles with -p, doppler down and range across
+//
+//usage: ./rangedoppler [options] ext.cap [ext_1.cap ...]
+
+#define MAX_SEGMENTS			256
+#define SPEED_OF_LIGHT			299792458.0
+#define PANEL_BINS				16			//range bins per doppler panel
+#define DEFAULT_BLOCK			256
+#define DEFAULT_RANGE_DB		60.0
+
+typedef struct
+{
+	float re;
+	float im;
+} Complex;
+
+typedef struct
+{
+	uint32_t n;
+	uint32_t* reverse;						//bit reversed index
+	Complex* twiddle;						//exp(-2 pi i k/n), k < n/2
+} FftPlan;
+
+typedef struct
+{
+	uint32_t first_ramp;
+	uint32_t n_gaps;						//ramps inside the block that follow missed triggers
+	double t;								//trigger time of the middle ramp [s]
+} BlockRow;
+
+#define BLOCK_DESCR "[('first_ramp', '<u4'), ('n_gaps', '<u4'), ('t', '<f8')]"
+
+typedef struct
+{
+	double bandwidth;						//[MHz]
+	double duration;						//[us]
+	double sample_rate;						//[Hz]
+	double trigger_period;					//[us]
+	char section[16];
+} Sweep;
+
+static CaptureMap maps[MAX_SEGMENTS];
+static uint64_t first_row[MAX_SEGMENTS + 1];
+static int n_segments = 0;
+
+static FftPlan range_plan, doppler_plan;
+static float* range_window;
+static float* doppler_window;
+static uint32_t ns_ramp;
+static uint32_t n_block;
+static uint32_t hop;
+static uint32_t n_range;
+static uint64_t n_blocks;
+
+static NpyMap map_output;
+static NpyMap block_output;
+static const char* prefix = "rd";
+static int is_tiles = 0;
+static double range_db = DEFAULT_RANGE_DB;
+
+static uint64_t next_block = 0;
+static int n_bad_ramps = 0;
+
+static double elapsed(struct timespec start, struct timespec end)
+{
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+}
+
+
+static void makePlan(FftPlan* plan, uint32_t n)
+{
+	int log2n = 0;
+	
+	while ((1u << log2n) < n)
+		log2n++;
+	
+	plan->n = n;
+	plan->reverse = (uint32_t*)malloc(n*sizeof(uint32_t));
+	plan->twiddle = (Complex*)malloc((n/2 + 1)*sizeof(Complex));
+	
+	for (uint32_t i = 0; i < n; i++)
+	{
+		uint32_t r = 0;
+		
+		for (int b = 0; b < log2n; b++)
+			r |= ((i >> b) & 1) << (log2n - 1 - b);
+		
+		plan->reverse[i] = r;
+	}
+	
+	for (uint32_t k = 0; k < n/2; k++)
+	{
+		plan->twiddle[k].re = cos(2.0*M_PI*k/n);
+		plan->twiddle[k].im = -sin(2.0*M_PI*k/n);
+	}
+}
+
+
+//in place radix-2 forward transform
+static void fft(const FftPlan* plan, Complex* x)
+{
+	const uint32_t n = plan->n;
+	
+	for (uint32_t i = 0; i < n; i++)
+	{
+		uint32_t r = plan->reverse[i];
+		
+		if (r > i)
+		{
+			Complex t = x[i];
+			x[i] = x[r];
+			x[r] = t;
+		}
+	}
+	
+	for (uint32_t size = 2; size <= n; size *= 2)
+	{
+		const uint32_t half = size/2;
+		const uint32_t step = n/size;
+		
+		for (uint32_t start = 0; start < n; start += size)
+		{
+			Complex* a = x + start;
+			Complex* b = x + start + half;
+			
+			for (uint32_t k = 0; k < half; k++)
+			{
+				const Complex w = plan->twiddle[k*step];
+				const float re = b[k].re*w.re - b[k].im*w.im;
+				const float im = b[k].re*w.im + b[k].im*w.re;
+				
+				b[k].re = a[k].re - re;
+				b[k].im = a[k].im - im;
+				a[k].re += re;
+				a[k].im += im;
+			}
+		}
+	}
+}
+
+
+static float* hannWindow(uint32_t n)
+{
+	float* w = (float*)malloc(n*sizeof(float));
+	
+	for (uint32_t i = 0; i < n; i++)
+		w[i] = 0.5 - 0.5*cos(2.0*M_PI*i/(n > 1 ? n - 1 : 1));
+	
+	return w;
+}
+
+
+//ramp by row across the segment files, zeros if it cannot be decoded
+static int readRamp(uint64_t row, int16_t* samples, RampMeta** meta)
+{
+	int s = 0;
+	
+	while (row >= first_row[s + 1])
+		s++;
+	
+	if (!readCaptureRamp(&maps[s], row - first_row[s], samples, meta))
+	{
+		memset(samples, 0, ns_ramp*sizeof(int16_t));
+		*meta = NULL;
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+//mean removed and windowed, starting at x[stride*i]
+static void loadRamp(const int16_t* samples, float* x, int stride)
+{
+	int64_t sum = 0;
+	
+	for (uint32_t i = 0; i < ns_ramp; i++)
+		sum += samples[i];
+	
+	const float dc = (float)sum/ns_ramp;
+	
+	for (uint32_t i = 0; i < ns_ramp; i++)
+		x[stride*i] = (samples[i] - dc)*range_window[i];
+}
+
+
+static void writeTile(uint64_t block, const float* power)
+{
+	char filename[1024];
+	float peak = -1e30f;
+	FILE* file;
+	
+	snprintf(filename, sizeof(filename), "%s_%05llu.pgm", prefix, (unsigned long long)block);
+	
+	if (!(file = fopen(filename, "wb")))
+		return;
+	
+	for (uint32_t i = 0; i < n_block*n_range; i++)
+		peak = fmaxf(peak, power[i]);
+	
+	uint8_t* row = (uint8_t*)malloc(n_range);
+	
+	fprintf(file, "P5\n%u %u\n255\n", n_range, n_block);
+	
+	for (uint32_t d = 0; d < n_block; d++)
+	{
+		for (uint32_t k = 0; k < n_range; k++)
+		{
+			float level = 255.0f*(power[d*n_range + k] - peak + range_db)/range_db;
+			row[k] = (level < 0) ? 0 : (level > 255) ? 255 : (uint8_t)level;
+		}
+		
+		fwrite(row, 1, n_range, file);
+	}
+	
+	free(row);
+	fclose(file);
+}
+
+
+//workers take whole blocks from a shared counter and own all of their buffers
+static void* runProcessor(void* arg)
+{
+	const uint32_t n_fft = range_plan.n;
+	int16_t* samples[2];
+	Complex* spectrum = (Complex*)malloc(n_fft*sizeof(Complex));
+	Complex* matrix = (Complex*)malloc((size_t)n_block*n_range*sizeof(Complex));
+	Complex* panel = (Complex*)malloc((size_t)PANEL_BINS*n_block*sizeof(Complex));
+	int bad_ramps = 0;
+	uint64_t block;
+	
+	(void)arg;
+	samples[0] = (int16_t*)malloc(ns_ramp*sizeof(int16_t));
+	samples[1] = (int16_t*)malloc(ns_ramp*sizeof(int16_t));
+	
+	while ((block = __atomic_fetch_add(&next_block, 1, __ATOMIC_RELAXED)) < n_blocks)
+	{
+		const uint64_t first = block*hop;
+		BlockRow* block_row = (BlockRow*)block_output.data + block;
+		float* power = (float*)map_output.data + block*n_block*n_range;
+		
+		memset(block_row, 0, sizeof(BlockRow));
+		
+		//range pass, two real ramps per complex transform
+		for (uint32_t p = 0; p < n_block; p += 2)
+		{
+			memset(spectrum, 0, n_fft*sizeof(Complex));
+			
+			for (int j = 0; j < 2; j++)
+			{
+				RampMeta* meta;
+				
+				if (!readRamp(first + p + j, samples[j], &meta))
+					bad_ramps++;
+				
+				if (meta && (p + j == 0))
+					block_row->first_ramp = meta->ramp;
+				
+				if (meta && (p + j == n_block/2))
+					block_row->t = meta->t;
+				
+				if (meta && (p + j > 0) && (meta->flags & RAMP_GAP))
+					block_row->n_gaps++;
+				
+				loadRamp(samples[j], j ? &spectrum[0].im : &spectrum[0].re, 2);
+			}
+			
+			fft(&range_plan, spectrum);
+			
+			Complex* x = matrix + (size_t)p*n_range;
+			Complex* y = x + n_range;
+			const float wx = 0.5f*doppler_window[p];
+			const float wy = 0.5f*doppler_window[p + 1];
+			
+			for (uint32_t k = 0; k < n_range; k++)
+			{
+				const Complex a = spectrum[k];
+				const Complex m = spectrum[(n_fft - k) & (n_fft - 1)];
+				
+				x[k].re = (a.re + m.re)*wx;
+				x[k].im = (a.im - m.im)*wx;
+				y[k].re = (a.im + m.im)*wy;
+				y[k].im = (m.re - a.re)*wy;
+			}
+		}
+		
+		//doppler pass over panels of range bins, written out with zero doppler in the middle row
+		for (uint32_t k0 = 0; k0 < n_range; k0 += PANEL_BINS)
+		{
+			const uint32_t n_bins = (n_range - k0 < PANEL_BINS) ? n_range - k0 : PANEL_BINS;
+			
+			for (uint32_t p = 0; p < n_block; p++)
+			{
+				for (uint32_t c = 0; c < n_bins; c++)
+					panel[c*n_block + p] = matrix[(size_t)p*n_range + k0 + c];
+			}
+			
+			for (uint32_t c = 0; c < n_bins; c++)
+				fft(&doppler_plan, panel + c*n_block);
+			
+			for (uint32_t d = 0; d < n_block; d++)
+			{
+				const uint32_t f = (d + n_block/2) & (n_block - 1);
+				
+				for (uint32_t c = 0; c < n_bins; c++)
+				{
+					const Complex v = panel[c*n_block + f];
+					power[(size_t)d*n_range + k0 + c] = 10.0f*log10f(v.re*v.re + v.im*v.im + 1e-20f);
+				}
+			}
+		}
+		
+		if (is_tiles)
+			writeTile(block, power);
+	}
+	
+	__atomic_add_fetch(&n_bad_ramps, bad_ramps, __ATOMIC_RELAXED);
+	free(samples[0]);
+	free(samples[1]);
+	free(spectrum);
+	free(matrix);
+	free(panel);
+	
+	return NULL;
+}
+
+
+static int summaryHandler(void* pointer, const char* section, const char* attribute, const char* value)
+{
+	Sweep* sweep = (Sweep*)pointer;
+	
+	if (!strcmp(section, "dataset") && !strcmp(attribute, "decimation_factor") && atof(value) > 0)
+		sweep->sample_rate = 125e6/atof(value);
+	else if (!strcmp(section, sweep->section) && !strcmp(attribute, "ramp_bandwidth"))
+		sweep->bandwidth = atof(value);
+	else if (!strcmp(section, sweep->section) && !strcmp(attribute, "ramp_duration"))
+		sweep->duration = atof(value);
+	else if (!strcmp(section, "missed") && !strcmp(attribute, "trigger_period"))
+		sweep->trigger_period = atof(value);
+	else if (!strcmp(section, "calibration") && !strcmp(attribute, "trigger_period") && sweep->trigger_period == 0)
+		sweep->trigger_period = atof(value);
+	
+	return 1;
+}
+
+
+//trigger rate from the first and last timed ramps, the along-track index counts missed triggers
+static double measurePrf(void)
+{
+	RampMeta *first = NULL, *last = NULL;
+	uint64_t n_rows = first_row[n_segments];
+	
+	for (uint64_t r = 0; r < n_rows && r < CAPTURE_CHUNK_RAMPS && !first; r++)
+	{
+		int s = 0;
+		
+		while (r >= first_row[s + 1])
+			s++;
+		
+		if (getCaptureRamp(&maps[s], r - first_row[s], &first) && first->t <= 0)
+			first = NULL;
+	}
+	
+	for (uint64_t r = n_rows; r > 0 && n_rows - r < CAPTURE_CHUNK_RAMPS && !last; r--)
+	{
+		int s = 0;
+		
+		while (r - 1 >= first_row[s + 1])
+			s++;
+		
+		if (getCaptureRamp(&maps[s], r - 1 - first_row[s], &last) && last->t <= 0)
+			last = NULL;
+	}
+	
+	if (!first || !last || last->ramp <= first->ramp || last->t <= first->t)
+		return 0;
+	
+	return (last->ramp - first->ramp)/(last->t - first->t);
+}
+
+
+static int writeAxis(const char* name, const float* axis, uint64_t n)
+{
+	char filename[1024];
+	NpyMap npy;
+	
+	snprintf(filename, sizeof(filename), "%s_%s.npy", prefix, name);
+	
+	if (!createNpy(&npy, filename, "'<f4'", &n, 1, sizeof(float)))
+		return 0;
+	
+	memcpy(npy.data, axis, n*sizeof(float));
+	
+	return closeNpy(&npy);
+}
+
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [options] <capture file> [<capture file> ...]\n", name);
+	fprintf(stderr, " -o out       output prefix (default rd)\n");
+	fprintf(stderr, " -i summary   summary.ini of the recording (default next to the first capture file)\n");
+	fprintf(stderr, " -s synth     synth section with the sampled ramp, 1 or 2 (default 2)\n");
+	fprintf(stderr, " -B MHz       ramp bandwidth, overrides the summary\n");
+	fprintf(stderr, " -T us        ramp duration, overrides the summary\n");
+	fprintf(stderr, " -P Hz        trigger rate, overrides the ramp times\n");
+	fprintf(stderr, " -n ramps     ramps per block, a power of two (default %i)\n", DEFAULT_BLOCK);
+	fprintf(stderr, " -H ramps     ramps between the starts of blocks (default one block)\n");
+	fprintf(stderr, " -r m         keep range bins up to this range\n");
+	fprintf(stderr, " -j threads   worker threads (default all cores)\n");
+	fprintf(stderr, " -p           write a pgm tile per block\n");
+	fprintf(stderr, " -D dB        dynamic range of the tiles (default %.0f)\n", DEFAULT_RANGE_DB);
+}
+
+
+int main(int argc, char *argv[])
+{
+	Sweep sweep;
+	const char* summary = NULL;
+	double bandwidth = 0, duration = 0, prf = 0, max_range = 0;
+	int synth = 2;
+	int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	
+	n_block = DEFAULT_BLOCK;
+	
+	while ((opt = getopt(argc, argv, "o:i:s:B:T:P:n:H:r:j:pD:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':	prefix = optarg;				break;
+			case 'i':	summary = optarg;				break;
+			case 's':	synth = atoi(optarg);			break;
+			case 'B':	bandwidth = atof(optarg);		break;
+			case 'T':	duration = atof(optarg);		break;
+			case 'P':	prf = atof(optarg);				break;
+			case 'n':	n_block = atoi(optarg);			break;
+			case 'H':	hop = atoi(optarg);				break;
+			case 'r':	max_range = atof(optarg);		break;
+			case 'j':	n_threads = atoi(optarg);		break;
+			case 'p':	is_tiles = 1;					break;
+			case 'D':	range_db = atof(optarg);		break;
+			default:
+				usage(argv[0]);
+				return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	
+	if (optind == argc || argc - optind > MAX_SEGMENTS || n_threads < 1 || (synth != 1 && synth != 2) ||
+		n_block < 2 || (n_block & (n_block - 1)) || range_db <= 0)
+	{
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	if (hop == 0)
+		hop = n_block;
+	
+	for (int i = optind; i < argc; i++, n_segments++)
+	{
+		if (!mapCapture(&maps[n_segments], argv[i]))
+		{
+			fprintf(stderr, "%s is not a capture container.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		
+		if (maps[n_segments].header->ns_ramp != maps[0].header->ns_ramp)
+		{
+			fprintf(stderr, "%s has %u samples per ramp, %s has %u.\n", argv[i], maps[n_segments].header->ns_ramp, argv[optind], maps[0].header->ns_ramp);
+			return EXIT_FAILURE;
+		}
+		
+		first_row[n_segments + 1] = first_row[n_segments] + maps[n_segments].n_ramps;
+	}
+	
+	//ramp parameters from the summary, the command line wins
+	char path[1024];
+	
+	memset(&sweep, 0, sizeof(Sweep));
+	snprintf(sweep.section, sizeof(sweep.section), (synth == 1) ? "synth_one" : "synth_two");
+	
+	if (!summary)
+	{
+		char* directory = strdup(argv[optind]);
+		
+		snprintf(path, sizeof(path), "%s/summary.ini", dirname(directory));
+		free(directory);
+		summary = path;
+	}
+	
+	if (ini_parse(summary, summaryHandler, &sweep) < 0)
+		printf("Could not read %s\n", summary);
+	
+	if (bandwidth != 0)
+		sweep.bandwidth = bandwidth;
+	
+	if (duration != 0)
+		sweep.duration = duration;
+	
+	if (sweep.sample_rate == 0)
+		sweep.sample_rate = maps[0].header->sample_rate;
+	
+	if (sweep.bandwidth == 0 || sweep.duration <= 0 || sweep.sample_rate <= 0)
+	{
+		fprintf(stderr, "No ramp_bandwidth and ramp_duration in [%s] of %s, give -B and -T.\n", sweep.section, summary);
+		return EXIT_FAILURE;
+	}
+	
+	if (prf == 0)
+		prf = measurePrf();
+	
+	if (prf == 0 && sweep.trigger_period > 0)
+		prf = 1e6/sweep.trigger_period;
+	
+	if (prf == 0)
+	{
+		printf("No trigger times or period, doppler in cycles per ramp\n");
+		prf = 1;
+	}
+	
+	//range of beat frequency f is c f/(2 slope)
+	ns_ramp = maps[0].header->ns_ramp;
+	
+	uint32_t n_fft = 2;
+	
+	while (n_fft < ns_ramp)
+		n_fft *= 2;
+	
+	const double slope = fabs(sweep.bandwidth)*1e6/(sweep.duration*1e-6);
+	const double bin_range = SPEED_OF_LIGHT*sweep.sample_rate/n_fft/(2*slope);
+	
+	n_range = n_fft/2;
+	
+	if (max_range > 0 && max_range/bin_range + 1 < n_range)
+		n_range = (uint32_t)(max_range/bin_range) + 1;
+	
+	if (ns_ramp/sweep.sample_rate > sweep.duration*1e-6)
+		fprintf(stderr, "Warning: %u samples span %.1f us, longer than the %.1f us ramp, the range axis only holds for samples within the ramp\n",
+			ns_ramp, ns_ramp/sweep.sample_rate*1e6, sweep.duration);
+	
+	uint64_t n_rows = first_row[n_segments];
+	n_blocks = (n_rows >= n_block) ? (n_rows - n_block)/hop + 1 : 0;
+	
+	if (n_blocks == 0)
+	{
+		fprintf(stderr, "%llu ramps, fewer than one block of %u.\n", (unsigned long long)n_rows, n_block);
+		return EXIT_FAILURE;
+	}
+	
+	makePlan(&range_plan, n_fft);
+	makePlan(&doppler_plan, n_block);
+	range_window = hannWindow(ns_ramp);
+	doppler_window = hannWindow(n_block);
+	
+	float* axis = (float*)malloc(((n_range > n_block) ? n_range : n_block)*sizeof(float));
+	
+	for (uint32_t k = 0; k < n_range; k++)
+		axis[k] = k*bin_range;
+	
+	int is_written = writeAxis("range", axis, n_range);
+	
+	for (uint32_t d = 0; d < n_block; d++)
+		axis[d] = ((double)d - n_block/2)*prf/n_block;
+	
+	is_written &= writeAxis("doppler", axis, n_block);
+	free(axis);
+	
+	char filename[1024];
+	
+	snprintf(filename, sizeof(filename), "%s.npy", prefix);
+	is_written &= createNpy(&map_output, filename, "'<f4'", (uint64_t[]){n_blocks, n_block, n_range}, 3, sizeof(float));
+	snprintf(filename, sizeof(filename), "%s_blocks.npy", prefix);
+	is_written &= createNpy(&block_output, filename, BLOCK_DESCR, &n_blocks, 1, sizeof(BlockRow));
+	
+	if (!is_written)
+	{
+		fprintf(stderr, "Could not create the output files.\n");
+		return EXIT_FAILURE;
+	}
+	
+	printf("Ramp: %.3f MHz in %.3f us (%s), %.3f MHz sampling, %u samples\n", sweep.bandwidth, sweep.duration, sweep.section, sweep.sample_rate/1e6, ns_ramp);
+	printf("Range: %u bins of %.3f m to %.1f m, resolution %.3f m\n", n_range, bin_range, (n_range - 1)*bin_range, SPEED_OF_LIGHT*sweep.sample_rate/ns_ramp/(2*slope));
+	printf("Doppler: %u bins of %.3f Hz at %.1f Hz prf, blocks every %u ramps\n", n_block, prf/n_block, prf, hop);
+	
+	pthread_t* threads = (pthread_t*)malloc(n_threads*sizeof(pthread_t));
+	struct timespec start, processed, end;
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	for (int t = 0; t < n_threads; t++)
+	{
+		if (pthread_create(&threads[t], NULL, runProcessor, NULL))
+		{
+			fprintf(stderr, "Could not start worker %i.\n", t);
+			n_threads = t;
+			break;
+		}
+	}
+	
+	for (int t = 0; t < n_threads; t++)
+		pthread_join(threads[t], NULL);
+	
+	clock_gettime(CLOCK_MONOTONIC, &processed);
+	
+	uint32_t n_gap_blocks = 0;
+	
+	for (uint64_t b = 0; b < n_blocks; b++)
+		n_gap_blocks += (((BlockRow*)block_output.data)[b].n_gaps > 0);
+	
+	is_written &= closeNpy(&map_output);
+	is_written &= closeNpy(&block_output);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	const double seconds = elapsed(start, processed);
+	const double n_ramps = (double)n_blocks*n_block;
+	
+	printf("Blocks: %llu of %u ramps in %.3f s on %i threads: %.0f ramps/s, %.1f MB/s of samples\n", (unsigned long long)n_blocks, n_block,
+		seconds, n_threads, n_ramps/seconds, n_ramps*ns_ramp*sizeof(int16_t)/1e6/seconds);
+	printf("Written back in %.3f s\n", elapsed(processed, end));
+	
+	if (n_gap_blocks > 0)
+		printf("Blocks with missed triggers (doppler smeared, record with -m to keep the ramp spacing): %u\n", n_gap_blocks);
+	
+	if (n_bad_ramps > 0)
+		printf("Ramps failing to decode (zeroed): %i\n", n_bad_ramps);
+	
+	if (!is_written)
+		fprintf(stderr, "Could not write the output.\n");
+	
+	for (int s = 0; s < n_segments; s++)
+		unmapCapture(&maps[s]);
+	
+	free(threads);
+	
+	return is_written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+
+//thin client for ./rpc -D, sends one command and prints the reply
+//usage: ./rpcctl start 20000 calibration flight
+//       ./rpcctl wait
+
+static int sendCommand(const char* command, char* reply, int size)
+{
+	struct sockaddr_un address;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	int length = 0;
+	
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, DAEMON_SOCKET, sizeof(address.sun_path) - 1);
+	
+	if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)))
+	{
+		fprintf(stderr, "rpc daemon is not running on %s.\n", DAEMON_SOCKET);
+		return 0;
+	}
+	
+	if (write(fd, command, strlen(command)) < 0)
+	{
+		close(fd);
+		return 0;
+	}
+	
+	int n;
+	
+	while ((length < size - 1) && ((n = read(fd, reply + length, size - 1 - length)) > 0))
+		length += n;
+	
+	reply[length] = '\0';
+	close(fd);
+	
+	return (length > 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+	char command[DAEMON_LINE_SIZE] = "";
+	char reply[DAEMON_LINE_SIZE];
+	
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s start <n_ramps> [comment] | stop | status | wait | config <lo.ini> <rf.ini> | quit\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	//wait polls status until the collection is finished
+	if (!strcmp(argv[1], "wait"))
+	{
+		do
+		{
+			if (!sendCommand("status\n", reply, sizeof(reply)))
+				return EXIT_FAILURE;
+			
+			usleep(1e5);
+		} while (!strncmp(reply, "OK running", 10));
+		
+		printf("%s", reply);
+		return EXIT_SUCCESS;
+	}
+	
+	for (int i = 1; i < argc; i++)
+	{
+		strncat(command, argv[i], sizeof(command) - strlen(command) - 2);
+		strncat(command, (i < argc - 1) ? " " : "\n", sizeof(command) - strlen(command) - 1);
+	}
+	
+	if (!sendCommand(command, reply, sizeof(reply)))
+		return EXIT_FAILURE;
+	
+	printf("%s", reply);
+	
+	return strncmp(reply, "OK", 2) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "preview.h"
+
+//attaches to the live preview ring of ./rpc -V and prints the running stats once per second.
+//frames that were overwritten or torn before they could be copied are counted as dropped.
+//usage: ./rpcview [-n frames] [-w]   (-w waits for a collection to start, otherwise exit when idle)
+
+static volatile sig_atomic_t is_running = 1;
+
+static void stop(int signal)
+{
+	is_running = 0;
+}
+
+
+//copy frame k out of the ring, returns 0 if it was overwritten while copying
+static int readFrame(const PreviewRing* ring, uint64_t k, PreviewFrame* copy)
+{
+	const PreviewFrame* frame = &ring->frames[k % PREVIEW_SLOTS];
+	uint32_t before = __atomic_load_n(&frame->sequence, __ATOMIC_ACQUIRE);
+	
+	if (before & 1)
+		return 0;
+	
+	copy->frame = frame->frame;
+	copy->n_samples = frame->n_samples;
+	copy->meta = frame->meta;
+	
+	if (copy->n_samples > PREVIEW_MAX_SAMPLES)
+		return 0;
+	
+	memcpy(copy->samples, frame->samples, copy->n_samples*sizeof(int16_t));
+	
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	
+	return (__atomic_load_n(&frame->sequence, __ATOMIC_RELAXED) == before) && (copy->frame == k);
+}
+
+
+static void readStats(const PreviewRing* ring, PreviewStats* stats)
+{
+	uint32_t before;
+	
+	do
+	{
+		before = __atomic_load_n(&ring->stats_sequence, __ATOMIC_ACQUIRE);
+		*stats = ring->stats;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((before & 1) || (__atomic_load_n(&ring->stats_sequence, __ATOMIC_RELAXED) != before));
+}
+
+
+int main(int argc, char *argv[])
+{
+	static PreviewFrame frame;
+	uint64_t n_frames = 0;
+	int is_waiting = 0;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "n:w")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				n_frames = strtoull(optarg, NULL, 10);
+				break;
+			case 'w':
+				is_waiting = 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n frames] [-w]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	
+	int fd = shm_open(PREVIEW_NAME, O_RDONLY, 0);
+	
+	//the ring is created by the first collection with -V
+	while (fd < 0 && is_waiting && is_running)
+	{
+		usleep(100000);
+		fd = shm_open(PREVIEW_NAME, O_RDONLY, 0);
+	}
+	
+	if (fd < 0)
+	{
+		fprintf(stderr, "no preview ring at %s, start rpc with -V.\n", PREVIEW_NAME);
+		return EXIT_FAILURE;
+	}
+	
+	PreviewRing* ring = mmap(NULL, sizeof(PreviewRing), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (ring == MAP_FAILED || ring->magic != PREVIEW_MAGIC || ring->version != PREVIEW_VERSION || ring->size != sizeof(PreviewRing))
+	{
+		fprintf(stderr, "%s is not a compatible preview ring.\n", PREVIEW_NAME);
+		return EXIT_FAILURE;
+	}
+	
+	uint32_t generation = 0;
+	uint64_t next = 0;
+	uint64_t n_read = 0;
+	uint64_t n_dropped = 0;
+	uint64_t n_second = 0;
+	time_t t_report = time(NULL);
+	int is_attached = 0;
+	
+	while (is_running && (!n_frames || n_read < n_frames))
+	{
+		int is_active = __atomic_load_n(&ring->is_active, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&ring->n_published, __ATOMIC_ACQUIRE);
+		
+		//a new collection restarts the frame numbers
+		if (is_active && (!is_attached || ring->generation != generation))
+		{
+			generation = ring->generation;
+			next = 0;
+			is_attached = 1;
+			printf("attached to collection %s, every %u ramps at %.3f MHz\n", ring->timestamp, ring->every, ring->sample_rate/1e6);
+		}
+		
+		if (!is_attached)
+		{
+			if (!is_waiting)
+			{
+				fprintf(stderr, "no collection is publishing, use -w to wait for one.\n");
+				break;
+			}
+			
+			usleep(10000);
+			continue;
+		}
+		
+		//frames older than the ring have been overwritten
+		if (head > next + PREVIEW_SLOTS)
+		{
+			n_dropped += head - PREVIEW_SLOTS - next;
+			next = head - PREVIEW_SLOTS;
+		}
+		
+		for (; next < head && (!n_frames || n_read < n_frames); next++)
+		{
+			if (readFrame(ring, next, &frame))
+			{
+				n_read++;
+				n_second++;
+			}
+			else
+				n_dropped++;
+		}
+		
+		if (time(NULL) != t_report)
+		{
+			PreviewStats stats;
+			readStats(ring, &stats);
+			
+			printf("ramp %8u  %4llu fps  rms %7.1f  dc %7.1f  hf %.2f  clipped %u  dead %u  dropped %llu\n", 
+				stats.last_ramp, (unsigned long long)n_second, stats.rms_mean, stats.dc_mean, stats.hf_ratio_mean, 
+				stats.n_clipped, stats.n_dead, (unsigned long long)n_dropped);
+			
+			t_report = time(NULL);
+			n_second = 0;
+		}
+		
+		//stop when the collection has finished and every frame was seen
+		if (!is_active && next >= head)
+		{
+			if (!is_waiting)
+				break;
+			
+			is_attached = 0;
+		}
+		
+		usleep(1000);
+	}
+	
+	printf("frames read: %llu, dropped: %llu\n", (unsigned long long)n_read, (unsigned long long)n_dropped);
+	munmap(ring, sizeof(PreviewRing));
+	
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,527 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <termios.h>
+
+#include "imu.h"
+
+//um7 emulator on a pseudo terminal. answers writeRegister/writeCommand with
+//checksummed replies and broadcasts health, processed, pose and gps packets at
+//the rates written to CREG_COM_RATES* (or those given here), paced at the baud
+//rate. bytes can be corrupted or dropped to exercise the resynchronisation.
+//usage: ./um7sim [-l link] [-b baud] [-H hz] [-A hz] [-Q hz] [-G hz] [-e p] [-x p] [-s seed]
+//       ./rpc -i -U /tmp/ttyUM7 ...
+
+#define SIM_OUT_SIZE			4096		//bytes queued towards the reader, like the um7 tx fifo
+#define SIM_TICK				100e-6		//scheduler period [s]
+#define SIM_GPS_RATE			1.0			//default gps broadcast rate [Hz]
+
+enum {STREAM_HEALTH, STREAM_PROC, STREAM_QUAT, STREAM_POSITION, STREAM_VELOCITY, STREAM_GPS, STREAMS};
+
+typedef struct
+{
+	const char* name;
+	uint8_t address;
+	int n_registers;
+	double rate;							//broadcasts per second, 0 when off
+	int is_fixed;							//rate given on the command line
+	double t_next;
+	uint64_t n_sent;
+} Stream;
+
+static Stream streams[STREAMS] =
+{
+	{"health",   DREG_HEALTH,        1},
+	{"proc",     DREG_ALL_PROC,      12},
+	{"quat",     DREG_QUAT_AB,       3},
+	{"position", DREG_POSITION_N,    4},
+	{"velocity", DREG_VELOCITY_N,    4},
+	{"gps",      DREG_GPS_LATITUDE,  6},
+};
+
+static uint8_t registers[256][4];
+static uint8_t out_buffer[SIM_OUT_SIZE];
+static int out_length = 0;
+static uint8_t in_buffer[512];
+static int in_length = 0;
+
+static double bit_error_rate = 0;
+static double drop_rate = 0;
+static uint64_t n_commands = 0;
+static uint64_t n_overrun = 0;				//packets dropped because the reader fell behind
+static uint64_t n_corrupted = 0;
+static uint64_t n_dropped = 0;
+static uint64_t n_bytes = 0;
+
+static volatile sig_atomic_t is_running = 1;
+
+static void stop(int signal)
+{
+	is_running = 0;
+}
+
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+static void putFloat(uint8_t* data, float value)
+{
+	uint32_t bit32;
+	memcpy(&bit32, &value, sizeof(float));
+	
+	data[0] = bit32 >> 24;
+	data[1] = bit32 >> 16;
+	data[2] = bit32 >> 8;
+	data[3] = bit32;
+}
+
+
+static void putInt16(uint8_t* data, int16_t value)
+{
+	data[0] = (uint16_t)value >> 8;
+	data[1] = (uint16_t)value;
+}
+
+
+//queues one packet, the whole packet is lost if the fifo is full
+static void queuePacket(uint8_t packet_type, uint8_t address, const uint8_t* data, int n_data_bytes)
+{
+	int length = n_data_bytes + 7;
+	
+	if (out_length + length > SIM_OUT_SIZE)
+	{
+		n_overrun++;
+		return;
+	}
+	
+	uint8_t* packet = &out_buffer[out_length];
+	uint16_t checksum = 's' + 'n' + 'p' + packet_type + address;
+	
+	packet[0] = 's';
+	packet[1] = 'n';
+	packet[2] = 'p';
+	packet[3] = packet_type;
+	packet[4] = address;
+	
+	for (int i = 0; i < n_data_bytes; i++)
+	{
+		packet[5 + i] = data[i];
+		checksum += data[i];
+	}
+	
+	packet[5 + n_data_bytes] = checksum >> 8;
+	packet[6 + n_data_bytes] = checksum;
+	out_length += length;
+}
+
+
+//broadcast rates follow the com rate registers unless they were fixed on the command line
+static void updateRates(void)
+{
+	static const double health_rates[8] = {0, 0.125, 0.25, 0.5, 1, 2, 4, 8};
+	
+	double rates[STREAMS];
+	
+	rates[STREAM_HEALTH] = health_rates[registers[CREG_COM_RATES6][1] & 0x07];
+	rates[STREAM_PROC] = registers[CREG_COM_RATES4][3];
+	rates[STREAM_QUAT] = registers[CREG_COM_RATES5][0];
+	rates[STREAM_POSITION] = registers[CREG_COM_RATES5][2];
+	rates[STREAM_VELOCITY] = registers[CREG_COM_RATES5][3];
+	rates[STREAM_GPS] = SIM_GPS_RATE;
+	
+	for (int i = 0; i < STREAMS; i++)
+		if (!streams[i].is_fixed)
+			streams[i].rate = rates[i];
+}
+
+
+//register contents of a broadcast at time t, a platform flying north at 10 m/s in a slow turn
+static void fillStream(int stream, double t, uint8_t* data)
+{
+	double heading = 0.1*t;
+	
+	switch (stream)
+	{
+		case STREAM_HEALTH:
+			putFloat(data, 0);
+			data[0] = 8 << 2;				//satellites used, bits 26-31
+			data[2] = 10 << 2;				//satellites in view, bits 10-15
+			data[3] = 0;
+			break;
+		
+		case STREAM_PROC:
+			for (int i = 0; i < 3; i++)
+			{
+				putFloat(&data[4*i], 0.1*sin(t + i));
+				putFloat(&data[16 + 4*i], (i == 2) ? -1 : 0.01*cos(t + i));
+				putFloat(&data[32 + 4*i], 0.5*cos(heading + i));
+			}
+			
+			putFloat(&data[12], t);
+			putFloat(&data[28], t);
+			putFloat(&data[44], t);
+			break;
+		
+		case STREAM_QUAT:
+			putInt16(&data[0], cos(heading/2)*QUAT_SCALE);
+			putInt16(&data[2], 0);
+			putInt16(&data[4], 0);
+			putInt16(&data[6], sin(heading/2)*QUAT_SCALE);
+			putFloat(&data[8], t);
+			break;
+		
+		case STREAM_POSITION:
+			putFloat(&data[0], 10*t);
+			putFloat(&data[4], 0);
+			putFloat(&data[8], 100);
+			putFloat(&data[12], t);
+			break;
+		
+		case STREAM_VELOCITY:
+			putFloat(&data[0], 10);
+			putFloat(&data[4], 0);
+			putFloat(&data[8], 0);
+			putFloat(&data[12], t);
+			break;
+		
+		case STREAM_GPS:
+		{
+			//utc time of the last fix as hhmmss.ss, a new fix every second
+			time_t utc = time(NULL);
+			struct tm tm;
+			gmtime_r(&utc, &tm);
+			
+			putFloat(&data[0], -33.9 + 10*t/111e3);
+			putFloat(&data[4], 18.4);
+			putFloat(&data[8], 100);
+			putFloat(&data[12], 0);
+			putFloat(&data[16], 10);
+			putFloat(&data[20], tm.tm_hour*10000 + tm.tm_min*100 + tm.tm_sec);
+			break;
+		}
+	}
+}
+
+
+//replies to the packets of writeRegister, readRegister and writeCommand
+static void handleCommand(uint8_t packet_type, uint8_t address, const uint8_t* data, int n_data_bytes)
+{
+	n_commands++;
+	
+	if (address >= GET_FW_REVISION)
+	{
+		if (address == GET_FW_REVISION)
+			queuePacket(PT_HAS_DATA, address, (const uint8_t*)"U7SM", 4);
+		else
+			queuePacket(PT_READ, address, NULL, 0);
+		
+		return;
+	}
+	
+	//a write is acknowledged without data, a read returns the register
+	if (n_data_bytes >= 4)
+	{
+		memcpy(registers[address], data, 4);
+		updateRates();
+		queuePacket(PT_READ, address, NULL, 0);
+	}
+	else
+	{
+		queuePacket(PT_HAS_DATA, address, registers[address], 4);
+	}
+}
+
+
+//drains the bytes written by the reader and answers complete packets
+static void readCommands(int fd)
+{
+	int n = read(fd, &in_buffer[in_length], sizeof(in_buffer) - in_length);
+	
+	if (n > 0)
+		in_length += n;
+	
+	int index = 0;
+	
+	while (index + 7 <= in_length)
+	{
+		if (in_buffer[index] != 's' || in_buffer[index + 1] != 'n' || in_buffer[index + 2] != 'p')
+		{
+			index++;
+			continue;
+		}
+		
+		uint8_t packet_type = in_buffer[index + 3];
+		int n_data_bytes = (packet_type & PT_HAS_DATA) ? ((packet_type & PT_IS_BATCH) ? 4*((packet_type >> 2) & 0x0F) : 4) : 0;
+		
+		if (in_length - index < n_data_bytes + 7)
+			break;
+		
+		uint16_t checksum = 's' + 'n' + 'p' + packet_type + in_buffer[index + 4];
+		
+		for (int k = 0; k < n_data_bytes; k++)
+			checksum += in_buffer[index + 5 + k];
+		
+		if (checksum != ((in_buffer[index + 5 + n_data_bytes] << 8) | in_buffer[index + 6 + n_data_bytes]))
+		{
+			index++;
+			continue;
+		}
+		
+		handleCommand(packet_type, in_buffer[index + 4], &in_buffer[index + 5], n_data_bytes);
+		index += n_data_bytes + 7;
+	}
+	
+	//nothing useful is ever this far behind
+	if (index == 0 && in_length == sizeof(in_buffer))
+		index = in_length;
+	
+	memmove(in_buffer, &in_buffer[index], in_length - index);
+	in_length -= index;
+}
+
+
+//writes up to n queued bytes with the configured line noise, returns the bytes taken from the queue
+static int writeBytes(int fd, int n)
+{
+	uint8_t line[SIM_OUT_SIZE];
+	int length = 0;
+	
+	if (bit_error_rate <= 0 && drop_rate <= 0)
+	{
+		length = write(fd, out_buffer, n);
+		return (length < 0) ? 0 : length;
+	}
+	
+	for (int i = 0; i < n; i++)
+	{
+		if ((double)rand()/RAND_MAX < drop_rate)
+		{
+			n_dropped++;
+			continue;
+		}
+		
+		line[length] = out_buffer[i];
+		
+		if ((double)rand()/RAND_MAX < bit_error_rate)
+		{
+			line[length] ^= 1 << (rand() & 7);
+			n_corrupted++;
+		}
+		
+		length++;
+	}
+	
+	//bytes the pty did not take are lost, as in a uart overflow
+	if (write(fd, line, length) < length)
+		n_overrun++;
+	
+	return n;
+}
+
+
+static void printStats(double t, uint64_t* last_sent, uint64_t last_bytes, double interval)
+{
+	printf("%8.1f s", t);
+	
+	for (int i = 0; i < STREAMS; i++)
+	{
+		printf("  %s %5.0f/s", streams[i].name, (streams[i].n_sent - last_sent[i])/interval);
+		last_sent[i] = streams[i].n_sent;
+	}
+	
+	printf("  %6.1f kB/s  commands %llu  overrun %llu  corrupted %llu  dropped %llu\n", (n_bytes - last_bytes)/interval/1e3,
+		(unsigned long long)n_commands, (unsigned long long)n_overrun, (unsigned long long)n_corrupted, (unsigned long long)n_dropped);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char* link = NULL;
+	double baud = 115200;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "l:b:H:A:Q:G:e:x:s:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l':
+				link = optarg;
+				break;
+			case 'b':
+				baud = atof(optarg);
+				break;
+			case 'H':
+				streams[STREAM_HEALTH].rate = atof(optarg);
+				streams[STREAM_HEALTH].is_fixed = 1;
+				break;
+			case 'A':
+				streams[STREAM_PROC].rate = atof(optarg);
+				streams[STREAM_PROC].is_fixed = 1;
+				break;
+			case 'Q':
+				for (int i = STREAM_QUAT; i <= STREAM_VELOCITY; i++)
+				{
+					streams[i].rate = atof(optarg);
+					streams[i].is_fixed = 1;
+				}
+				break;
+			case 'G':
+				streams[STREAM_GPS].rate = atof(optarg);
+				streams[STREAM_GPS].is_fixed = 1;
+				break;
+			case 'e':
+				bit_error_rate = atof(optarg);
+				break;
+			case 'x':
+				drop_rate = atof(optarg);
+				break;
+			case 's':
+				srand(atoi(optarg));
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-l link] [-b baud, 0 unpaced] [-H health hz] [-A all proc hz] [-Q pose hz] [-G gps hz]\n"
+					"       [-e byte error probability] [-x byte drop probability] [-s seed]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	
+	if (fd < 0 || grantpt(fd) || unlockpt(fd))
+	{
+		fprintf(stderr, "Could not open a pseudo terminal, %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	
+	const char* device = ptsname(fd);
+	
+	//hold the slave open so that reads do not fail between readers
+	int slave_fd = open(device, O_RDWR | O_NOCTTY);
+	struct termios settings;
+	
+	//no echo of the broadcasts back to us until the reader sets up the line
+	if (slave_fd >= 0 && !tcgetattr(slave_fd, &settings))
+	{
+		cfmakeraw(&settings);
+		tcsetattr(slave_fd, TCSANOW, &settings);
+	}
+	
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	
+	if (link)
+	{
+		unlink(link);
+		
+		if (symlink(device, link))
+		{
+			fprintf(stderr, "Could not link %s, %s\n", link, strerror(errno));
+			link = NULL;
+		}
+	}
+	
+	printf("UM7 on %s%s%s\n", link ? link : device, link ? " -> " : "", link ? device : "");
+	fflush(stdout);
+	
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	updateRates();
+	
+	uint64_t last_sent[STREAMS] = {0};
+	uint64_t last_bytes = 0;
+	double t_start = now();
+	double t_report = t_start + 1;
+	double t_line = t_start;				//time the line has been busy until
+	
+	for (int i = 0; i < STREAMS; i++)
+		streams[i].t_next = t_start;
+	
+	while (is_running)
+	{
+		double t = now();
+		uint8_t data[PACKET_DATA_SIZE];
+		
+		//an idle line does not save up time
+		if (out_length == 0 && t_line < t)
+			t_line = t;
+		
+		readCommands(fd);
+		
+		for (int i = 0; i < STREAMS; i++)
+		{
+			if (streams[i].rate <= 0)
+			{
+				streams[i].t_next = t;
+				continue;
+			}
+			
+			while (streams[i].t_next <= t)
+			{
+				uint8_t packet_type = PT_HAS_DATA | ((streams[i].n_registers > 1) ? PT_IS_BATCH | (streams[i].n_registers << 2) : 0);
+				
+				fillStream(i, t - t_start, data);
+				queuePacket(packet_type, streams[i].address, data, 4*streams[i].n_registers);
+				streams[i].n_sent++;
+				streams[i].t_next += 1/streams[i].rate;
+			}
+		}
+		
+		//10 bits per byte on the line
+		int n = out_length;
+		
+		if (baud > 0)
+		{
+			double budget = (t - t_line)*baud/10;
+			n = (budget < n) ? (int)budget : n;
+		}
+		
+		if (n > 0)
+		{
+			int written = writeBytes(fd, n);
+			
+			memmove(out_buffer, &out_buffer[written], out_length - written);
+			out_length -= written;
+			n_bytes += written;
+			
+			if (baud > 0)
+				t_line += written*10/baud;
+		}
+		
+		if (t >= t_report)
+		{
+			printStats(t - t_start, last_sent, last_bytes, t - t_report + 1);
+			last_bytes = n_bytes;
+			t_report = t + 1;
+			fflush(stdout);
+		}
+		
+		usleep(SIM_TICK*1e6);
+	}
+	
+	printf("sent");
+	
+	for (int i = 0; i < STREAMS; i++)
+		printf(" %s %llu", streams[i].name, (unsigned long long)streams[i].n_sent);
+	
+	printf(", %llu bytes, %llu commands, %llu overrun, %llu corrupted, %llu dropped\n", (unsigned long long)n_bytes,
+		(unsigned long long)n_commands, (unsigned long long)n_overrun, (unsigned long long)n_corrupted, (unsigned long long)n_dropped);
+	
+	if (link)
+		unlink(link);
+	
+	close(slave_fd);
+	close(fd);
+	
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "capture.h"
+
+//expands a capture container (any sample format) into a headerless stream of int16_t ramps (the old ext.bin layout)
+//usage: ./unpack14 ext.cap ext.bin
+
+int main(int argc, char *argv[])
+{
+	CaptureMap map;
+	FILE* outFile;
+	
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <capture file> <output file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	if (!mapCapture(&map, argv[1]))
+	{
+		fprintf(stderr, "%s is not a capture container.\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	
+	if (!(outFile = fopen(argv[2], "wb")))
+	{
+		fprintf(stderr, "Could not open %s.\n", argv[2]);
+		unmapCapture(&map);
+		return EXIT_FAILURE;
+	}
+	
+	uint32_t ns_ramp = map.header->ns_ramp;
+	int16_t* samples = (int16_t*)malloc(ns_ramp*sizeof(int16_t));
+	int n_bad_chunks = 0;
+	
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	for (uint32_t c = 0; c < map.n_chunks; c++)
+	{
+		if (!checkCaptureChunk(&map, c))
+			n_bad_chunks++;
+	}
+	
+	int n_bad_ramps = 0;
+	
+	for (uint32_t r = 0; r < map.n_ramps; r++)
+	{
+		if (!readCaptureRamp(&map, r, samples, NULL))
+		{
+			memset(samples, 0, ns_ramp*sizeof(int16_t));
+			n_bad_ramps++;
+		}
+		
+		fwrite(samples, sizeof(int16_t), ns_ramp, outFile);
+	}
+	
+	fclose(outFile);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+	double megabytes = (double)map.n_ramps*ns_ramp*sizeof(int16_t)/1e6;
+	
+	printf("Ramps: %u x %u samples (%s)\n", map.n_ramps, ns_ramp, sampleFormatName(map.header->sample_format));
+	printf("Output: %.2f MB in %.3f s (%.1f MB/s)\n", megabytes, seconds, megabytes/seconds);
+	
+	if (n_bad_chunks > 0)
+		printf("Chunks failing crc: %i\n", n_bad_chunks);
+	
+	if (n_bad_ramps > 0)
+		printf("Ramps failing to decode: %i\n", n_bad_ramps);
+	
+	free(samples);
+	unmapCapture(&map);
+	
+	return EXIT_SUCCESS;
+}